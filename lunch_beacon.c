@@ -26,7 +26,8 @@
 #include "ext_flash.h"
 #include "atm_gpio.h"
 #include "atm_log.h"
-#include "atm_asm.h"
+#include "lunch_log.h"
+#include "lunch_trace.h"
 #include "atm_gap.h"
 #include "atm_pm.h"
 #include "atm_gap_param.h"
@@ -34,6 +35,8 @@
 #include "atm_adv_param.h"
 #include "atm_adv.h"
 #include "atm_button.h"
+#include "sw_timer.h"
+#include "timer.h"
 #include "at_apb_pseq_regs_core_macro.h"
 #include "at_wrpr.h"
 #include "base_addr.h"
@@ -43,9 +46,23 @@
 // My stuff
 #include "lunch_beacon.h"
 #include "lunch_button.h"
+#ifndef CFG_LUNCH_BEACON_ONLY
 #include "lunch_gatt.h"
+#endif
 #include "lunch_nvds.h"
 #include "lunch_led.h"
+#include "lunch_adv_ca.h"
+#include "lunch_energy.h"
+#include "lunch_wurx.h"
+#include "lunch_sched.h"
+#include "lunch_wurx_tune.h"
+#include "lunch_adv_learn.h"
+#include "lunch_sleep.h"
+#include "lunch_wake.h"
+#include "lunch_fsm.h"
+#include "lunch_conn.h"
+#include "lunch_ota.h"
+#include "cfg_lunch_params.h"
 
 ATM_LOG_LOCAL_SETTING("lunch_beacon", V);
 
@@ -56,20 +73,23 @@ ATM_LOG_LOCAL_SETTING("lunch_beacon", V);
 
 static uint8_t act_to_idx(uint8_t act_idx);
 static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_code_t status);
+static void lunch_hibernate(void);
 
 /*
  * DEFINES
  *******************************************************************************
  */
 
-#define S_TBL_IDX 0
-
 #define GET_CREATE_ADV(act_idx) (app_env.create[act_to_idx(act_idx)])
 #define GET_START_ADV(act_idx) (app_env.start[act_to_idx(act_idx)])
 #define GET_ADV_DATA(act_idx) (app_env.adv_data[act_to_idx(act_idx)])
 #define GET_SCAN_DATA(act_idx) (app_env.scan_data[act_to_idx(act_idx)])
 
 #define ADV_LUNCH_DATA_IDX 8
+#define SCANRSP_VBAT_IDX 10
+#define SCANRSP_WAKE_IDX 11
+#define SCANRSP_PHASE_IDX 13
+#define SCANRSP_INTV_IDX 14
 
 /*
  * VARIABLES
@@ -78,6 +98,13 @@ static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_cod
 
 static app_env_t app_env;
 static pm_lock_id_t lock_hiber;
+static sw_timer_id_t lunch_adv_start_tid;
+static sw_timer_id_t warm_tid;
+static uint32_t last_wake_time;
+static bool warm;
+// For the scan response, so the gate can tell one wake from the next
+static uint8_t warm_restarts;
+static uint16_t start_delay_cs;
 
 /*
  * GAP CALLBACKS
@@ -88,9 +115,10 @@ static pm_lock_id_t lock_hiber;
  * @brief Callback registered with the GAP layer
  * @note Called after the GAP layer has initialized
  */
-static void gap_init_cfm(ble_err_code_t status)
+__WAKE_PATH static void gap_init_cfm(ble_err_code_t status)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_GAP_INIT_CFM, "gap_init_cfm");
+    LUNCH_TRACE(TR_GAP, TR_GAP_INIT_CFM, status);
 
     // Register adv state change callbacks
     atm_adv_reg(adv_state_change);
@@ -98,17 +126,21 @@ static void gap_init_cfm(ble_err_code_t status)
     // Set max transmit power
     atm_ble_set_txpwr_max(CFG_ADV0_CREATE_MAX_TX_POWER);
 
+    // Seed lunch adv collision avoidance for this wake
+    lunch_adv_ca_init();
+
     // Init act_idx to ATM_INVALID_ACTIDX(0xFF)
     for (uint8_t idx = 0; idx < CFG_GAP_ADV_MAX_INST; idx++){
         app_env.act_idx[idx] = ATM_INVALID_ACTIDX;
     }
+    app_env.create_q_len = 0;
 
     // Create lunch adv if awoken normally by WuRX
-    if(atm_asm_get_latest_transition(S_TBL_IDX).operation == OP_MODULE_INIT)
-        atm_asm_move(S_TBL_IDX, OP_CREATE_LUNCH_ADV);
+    if(lunch_fsm_last_op() == OP_MODULE_INIT)
+        lunch_fsm_post(OP_CREATE_LUNCH_ADV);
     // Create pair adv if awoken by button press
-    else if(atm_asm_get_latest_transition(S_TBL_IDX).operation == OP_CREATE_PAIR_ADV)
-        atm_asm_move(S_TBL_IDX, OP_CREATE_PAIR_ADV);
+    else if(lunch_fsm_last_op() == OP_CREATE_PAIR_ADV)
+        lunch_fsm_post(OP_CREATE_PAIR_ADV);
 } 
 
 /*
@@ -117,14 +149,16 @@ static void gap_init_cfm(ble_err_code_t status)
  */
 static void gap_conn_ind(uint8_t conidx, atm_connect_info_t *param)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_GAP_CONN_IND, "gap_conn_ind");
+    LUNCH_TRACE(TR_GAP, TR_GAP_CONN_IND, conidx);
 
-    if(app_env.current_adv_idx != PAIR_ADV_TYPE) {
-        ATM_LOG(E, "Connection established but it's not from pair adv?");
+    if(!app_env.adv_on[IDX_PAIR_ADV]) {
+        ATM_LOG(E, "Connection established but pair adv is not on?");
         return;
     }
 
-    ATM_LOG(D, "TODO: Reject connection if we already have one");
+    // One central at a time, within the idle and session limits
+    if(!lunch_conn_accept(conidx, param->peer_addr.addr.addr)) return;
 
     // Set max transmit power for given connection
     atm_ble_set_con_txpwr(conidx, CFG_ADV1_CREATE_MAX_TX_POWER);
@@ -133,7 +167,7 @@ static void gap_conn_ind(uint8_t conidx, atm_connect_info_t *param)
     atm_gap_print_conn_param(param);
     atm_gap_connect_accept(conidx);
     // atm_gap_get_link_info(conidx, BLE_GAP_GET_PHY);
-    atm_asm_move(S_TBL_IDX, OP_CONNECTED);
+    lunch_fsm_post(OP_CONNECTED);
 }
 
 /*
@@ -142,9 +176,16 @@ static void gap_conn_ind(uint8_t conidx, atm_connect_info_t *param)
  */
 static void gap_disc_ind(uint8_t conidx, ble_gap_ind_discon_t const *param)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_GAP_DISC_IND, "gap_disc_ind");
+    LUNCH_TRACE(TR_GAP, TR_GAP_DISC_IND, conidx);
 
-    atm_asm_move(S_TBL_IDX, OP_DISCONNECTED);
+    // A refused connection going away doesn't end the real one
+    if(!lunch_conn_closed(conidx)) return;
+
+    // Keep what arrived of an update, the next connection resumes it
+    lunch_ota_suspend();
+
+    lunch_fsm_post(OP_DISCONNECTED);
 }
 
 /*
@@ -182,8 +223,9 @@ static const atm_gap_cbs_t gap_callbacks = {
 __FAST static rep_vec_err_t
 wurx_adv_prevent_hib(bool *prevent, int32_t *pseq_dur, int32_t ble_dur)
 {
-    if (!boot_was_cold()) {
-        ATM_LOG(D, "Enabling WuRX");
+    // Outside the lunch windows only the schedule timer wakes us
+    if (lunch_sched_prevent_hib(pseq_dur) && !boot_was_cold()) {
+        LUNCH_LOG(D, LL_WURX_ENABLE, "Enabling WuRX");
 	    wurx_enable();
     }
     return RV_NEXT;
@@ -195,17 +237,176 @@ wurx_adv_prevent_hib(bool *prevent, int32_t *pseq_dur, int32_t ble_dur)
  *******************************************************************************
  */
 
-static void asm_state_change_cb(ASM_S last_s, ASM_O op, ASM_S next_s)
+__WAKE_PATH static void fsm_state_change_cb(uint8_t last_s, uint8_t op, uint8_t next_s)
 {
-    ATM_LOG(V, "ASM State Change from %d to %d, with OP Code %d", last_s, next_s, op);
+    LUNCH_LOG(V, LL_ASM_STATE, "State change from %d to %d, with OP Code %d", last_s, next_s, op);
+    LUNCH_TRACE(TR_STATE, last_s, next_s | (op << 8));
+
+    // Charge time spent in each state to its energy phase
+    switch (next_s) {
+        case S_INIT: {
+            lunch_energy_phase(ENERGY_BOOT);
+        } break;
+        case S_IDLE: {
+            lunch_energy_phase(warm ? ENERGY_RETAIN : ENERGY_GAP_INIT);
+        } break;
+        case S_STARTING_LUNCH_ADV:
+        case S_STARTING_PAIR_ADV: {
+            lunch_energy_phase(ENERGY_GAP_INIT);
+        } break;
+        case S_ADV_STARTED:
+        case S_ADV_STOPPED: {
+            lunch_energy_phase(ENERGY_ADV);
+        } break;
+        case S_CONNECTED: {
+            lunch_energy_phase(ENERGY_CONNECTED);
+        } break;
+        default: break;
+    }
 }
 
 static void button_press_cb(void)
 {
-    atm_asm_move(S_TBL_IDX, OP_CREATE_PAIR_ADV);
+#ifdef CFG_LUNCH_BEACON_ONLY
+    // Lunch data was flashed at the factory, there is nothing to pair
+    LUNCH_LOG(D, LL_PAIR_NOT_BUILT, "No pairing in a beacon only build");
+    return;
+#endif
+
+    // No transition while a set is being created or a central is connected
+    switch (lunch_fsm_state()) {
+        case S_INIT:
+        case S_IDLE:
+        case S_ADV_STARTED: {
+            lunch_fsm_post(OP_CREATE_PAIR_ADV);
+        } break;
+        default: {
+            LUNCH_LOG(D, LL_PAIR_ADV_BUSY, "Pair button ignored in state %d",
+                lunch_fsm_state());
+        } break;
+    }
+}
+
+/*
+ * @brief Per wake fields of the lunch scan response
+ * @note Set once per wake, never per adv event
+ */
+__WAKE_PATH static void lunch_fill_scanrsp(uint8_t *data, atm_adv_create_t const *create)
+{
+    // Battery level for the gate
+    data[SCANRSP_VBAT_IDX] = lunch_energy_vbat_byte();
+
+    // Which wake this is and how it started, for reception ratios at the gate
+    uint16_t wakes = lunch_energy_get()->wakes;
+    data[SCANRSP_WAKE_IDX] = wakes & 0xFF;
+    data[SCANRSP_WAKE_IDX + 1] = wakes >> 8;
+    data[SCANRSP_PHASE_IDX] = (start_delay_cs < 0xF ? start_delay_cs : 0xF) |
+        (warm_restarts < 0xF ? warm_restarts : 0xF) << 4;
+    uint32_t intv_ms = create->adv_param.prim_cfg.adv_intv_min * 5 / 8;
+    data[SCANRSP_INTV_IDX] = intv_ms < 0xFF ? intv_ms : 0xFF;
+}
+
+/*
+ * @brief Restart an adv set if it is still around, create it otherwise
+ */
+__WAKE_PATH static void adv_set_go(adv_set_t idx)
+{
+    if(app_env.act_idx[idx] != ATM_INVALID_ACTIDX) {
+        // A warm lunch adv gets this wake's scan response first,
+        // ATM_ADV_SCANDATA_DONE starts it
+        if(idx == IDX_LUNCH && app_env.scan_data[idx]) {
+            lunch_fill_scanrsp(app_env.scan_data[idx]->data, app_env.create[idx]);
+            if(atm_adv_set_scan_data(app_env.act_idx[idx], app_env.scan_data[idx]) == BLE_ERR_NO_ERROR)
+                return;
+        }
+        atm_adv_start(app_env.act_idx[idx], app_env.start[idx]);
+        return;
+    }
+
+    // ATM_ADV_CREATED only gives us the act_idx, remember which set it is for
+    app_env.create_q[app_env.create_q_len++] = idx;
+    atm_adv_create(app_env.create[idx]); // adv_state_change (ATM_ADV_CREATED)
+}
+
+/*
+ * @brief Pop the set that the next ATM_ADV_CREATED belongs to
+ */
+__WAKE_PATH static adv_set_t adv_set_created(void)
+{
+    ASSERT_ERR(app_env.create_q_len);
+    adv_set_t idx = app_env.create_q[0];
+    app_env.create_q_len--;
+    memmove(app_env.create_q, app_env.create_q + 1, app_env.create_q_len * sizeof(adv_set_t));
+    return idx;
 }
 
-static uint8_t act_to_idx(uint8_t act_idx)
+__WAKE_PATH static void lunch_adv_go(void)
+{
+    adv_set_go(IDX_LUNCH);
+}
+
+/*
+ * @brief Start the lunch adv once the collision avoidance start offset is over
+ */
+static void lunch_adv_start_timer(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(lunch_adv_start_tid);
+    lunch_adv_go();
+}
+
+/*
+ * @brief Lunch period is over, fall back to hibernation
+ */
+static void warm_timer(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(warm_tid);
+
+    // Pairing or adv in progress, lunch_s_sleep will hibernate when it's done
+    if(!warm || lunch_fsm_state() != S_IDLE) return;
+
+    LUNCH_LOG(D, LL_LUNCH_PERIOD_OVER, "Lunch period over");
+    lunch_hibernate();
+}
+
+/*
+ * @brief The gate is really there, not just RF noise
+ */
+static void lunch_gate_contact(void)
+{
+    lunch_wurx_tune_contact();
+    lunch_sched_gate_contact();
+    lunch_adv_learn_contact();
+}
+
+/*
+ * @brief WuRX hit while awake or in retention
+ * @note Awake it confirms the current wake. From retention it restarts the
+ * existing lunch adv
+ */
+static void wurx_gate_event(void)
+{
+    if(!warm) {
+        LUNCH_LOG(D, LL_WURX_AWAKE_HIT, "WuRX hit while awake");
+        lunch_gate_contact();
+        return;
+    }
+
+    LUNCH_LOG(D, LL_WURX_WARM_WAKE, "WuRX Warm Wake");
+    sw_timer_clear(warm_tid);
+    warm = false;
+    warm_restarts++;
+    last_wake_time = atm_get_sys_time();
+
+    // Heard again within the lunch period, so the last wake was the gate too
+    lunch_wurx_tune_wake();
+    lunch_sched_gate_contact();
+    lunch_adv_learn_wake();
+
+    if(lunch_fsm_state() == S_IDLE)
+        lunch_fsm_post(OP_CREATE_LUNCH_ADV);
+}
+
+__WAKE_PATH static uint8_t act_to_idx(uint8_t act_idx)
 {
     for (uint8_t idx = 0; idx < CFG_GAP_ADV_MAX_INST; idx++) {
 	if (app_env.act_idx[idx] == act_idx) {
@@ -217,20 +418,34 @@ static uint8_t act_to_idx(uint8_t act_idx)
     return 0;
 }
 
+#ifdef CFG_LUNCH_TOKENS
+/**
+ * @brief Copy this wake's token from the precomputed table into the adv data.
+ * @note No crypto here, the provisioning station already did it
+ * @returns false if no tokens have been provisioned
+ */
+__WAKE_PATH static bool lunch_fill_token(uint8_t *dst)
+{
+    // Every wake counted by the energy record moves on to the next token
+    if(nvds_get_lunch_token(lunch_energy_get()->wakes, dst) != NVDS_OK) {
+        ATM_LOG(W, "No lunch tokens, falling back to lunch data");
+        return false;
+    }
+    return true;
+}
+#endif
+
 /**
  * @brief Load adv and scan parameters and set them into GAP layer.
  * @note Called when the advertisement activity is created.
  */
-static void ble_adv_create_cfm(uint8_t act_idx, ble_err_code_t status)
+__WAKE_PATH static void ble_adv_create_cfm(uint8_t act_idx, ble_err_code_t status)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_ADV_CREATE_CFM, "ble_adv_create_cfm");
 
     ASSERT_INFO(status == BLE_ERR_NO_ERROR, act_idx, status);
 
-    uint8_t idx;
-
-    if(app_env.current_adv_idx == LUNCH_ADV_TYPE) idx = IDX_LUNCH;
-    if(app_env.current_adv_idx == PAIR_ADV_TYPE) idx = IDX_PAIR_ADV;
+    adv_set_t idx = adv_set_created();
 
     app_env.act_idx[idx] = act_idx;
     app_env.adv_data[idx] = atm_adv_advdata_param_get(idx);
@@ -242,22 +457,35 @@ static void ble_adv_create_cfm(uint8_t act_idx, ble_err_code_t status)
         uint8_t err = nvds_get_lunch_data(&lunch_data);
         if(err == NVDS_OK) {
             if(*lunch_data.school_id == 0 || *lunch_data.student_id == 0) {
-                ATM_LOG(D, "Lunch Data not set yet, don't start adv");
-                atm_asm_set_state_op(S_TBL_IDX, S_IDLE, OP_END);
+                LUNCH_LOG(D, LL_LUNCH_DATA_NOT_SET, "Lunch Data not set yet, don't start adv");
+                lunch_fsm_set(S_IDLE, OP_END);
                 return;
             }
 
-            memcpy((app_env.adv_data[idx]->data + ADV_LUNCH_DATA_IDX), (uint8_t *) &lunch_data, sizeof(nvds_lunch_data_t));
-            ATM_LOG(D, "Found Lunch Data - School ID: %s - Student ID: %s", 
-                lunch_data.school_id,
-                lunch_data.student_id);
-            ATM_LOG(D, "NEW ADV DATA: %s%s", (char *) app_env.adv_data[idx]->data, (char *) (app_env.adv_data[idx]->data + ADV_LUNCH_DATA_IDX+6));
+#ifdef CFG_LUNCH_TOKENS
+            if(lunch_fill_token(app_env.adv_data[idx]->data + ADV_LUNCH_DATA_IDX)) {
+                LUNCH_LOG(D, LL_LUNCH_TOKEN, "Advertising lunch token");
+            } else
+#endif
+            memcpy((app_env.adv_data[idx]->data + ADV_LUNCH_DATA_IDX), (uint8_t *) &lunch_data, LUNCH_IDS_LEN);
+
+            // Raw words so it stays cheap with the tokenized log
+            uint32_t adv_words[4];
+            memcpy(adv_words, app_env.adv_data[idx]->data + ADV_LUNCH_DATA_IDX, sizeof(adv_words));
+            LUNCH_LOG(D, LL_NEW_ADV_DATA, "NEW ADV DATA: %08x %08x %08x %08x",
+                adv_words[0], adv_words[1], adv_words[2], adv_words[3]);
         } else {
             ATM_LOG(E, "%s - Could not fetch lunch data. Err = %d", __func__, err);
             return;
         }
     }
 
+    if (idx == IDX_LUNCH) {
+        // Wake fields for the gate, and adv interval for energy accounting
+        lunch_fill_scanrsp(app_env.scan_data[idx]->data, app_env.create[idx]);
+        lunch_energy_set_adv_intv(app_env.create[idx]->adv_param.prim_cfg.adv_intv_min);
+    }
+
     {
         ble_err_code_t ret = atm_adv_set_data_sanity(app_env.create[idx], app_env.adv_data[idx], app_env.scan_data[idx]);
         if(ret != BLE_ERR_NO_ERROR) {
@@ -295,9 +523,10 @@ static void ble_adv_create_cfm(uint8_t act_idx, ble_err_code_t status)
  * @brief Callback registered with the atm_adv module
  * @note Called upon a state change in the advertising state machine
  */
-static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_code_t status)
+__WAKE_PATH static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_code_t status)
 {
-    ATM_LOG(V, "%s: act_idx=%d adv_state=%d", __func__, act_idx, state);
+    LUNCH_LOG(V, LL_ADV_STATE, "adv_state_change: act_idx=%d adv_state=%d", act_idx, state);
+    LUNCH_TRACE(TR_ADV_STATE, act_idx, state);
 
     ble_err_code_t ret = BLE_ERR_NO_ERROR;
 
@@ -310,7 +539,7 @@ static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_cod
         case ATM_ADV_DELETING: {
         } break;
         case ATM_ADV_CREATED: {
-            ATM_LOG(D, "ATM_ADV_CREATED act_idx=%d", act_idx);
+            LUNCH_LOG(D, LL_ADV_CREATED, "ATM_ADV_CREATED act_idx=%d", act_idx);
             ble_adv_create_cfm(act_idx, status);
         } break;
         case ATM_ADV_ADVDATA_DONE: {
@@ -319,35 +548,45 @@ static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_cod
             ret = atm_adv_start(act_idx, GET_START_ADV(act_idx));
         } break;
         case ATM_ADV_SCANDATA_DONE: {
-            if(atm_asm_get_current_state(S_TBL_IDX) == S_ADV_STARTED) break;
+            if(app_env.adv_on[act_to_idx(act_idx)]) break;
             ASSERT_INFO(status == BLE_ERR_NO_ERROR, act_idx, status);
             ret = atm_adv_start(act_idx, GET_START_ADV(act_idx));
         } break;
         case ATM_ADV_ON: {
             ASSERT_INFO(status == BLE_ERR_NO_ERROR, act_idx, status);
+
+            // First packet is out, the log can take the UART now
+            lunch_log_drain();
+            app_env.adv_on[act_to_idx(act_idx)] = true;
             if(act_to_idx(act_idx) == IDX_LUNCH) {
-                // Lunch beacon confirmation (can start now)
-                atm_asm_move(S_TBL_IDX, OP_CREATE_LUNCH_CFM);
+                // Lunch beacon confirmation (can start now). A restart while
+                // the pair adv is being set up only needs the flag above
+                if(lunch_fsm_state() == S_STARTING_LUNCH_ADV)
+                    lunch_fsm_post(OP_CREATE_LUNCH_CFM);
+
+                // Listen for the gate again to tell a real wake from noise
+                lunch_wurx_arm();
 
                 // Blink LED to confirm
                 // lunch_led_blink(LUNCH_LED_ACTIVE);
             } else {
                 // Pairing mode confirmation (can start now)
-                atm_asm_move(S_TBL_IDX, OP_CREATE_PAIR_CFM);
+                if(lunch_fsm_state() == S_STARTING_PAIR_ADV)
+                    lunch_fsm_post(OP_CREATE_PAIR_CFM);
 
                 // Blink LED to confirm
                 lunch_led_blink(LUNCH_LED_PAIRING);
             }
         } break;
         case ATM_ADV_OFF: {
-            if(atm_asm_get_current_state(S_TBL_IDX) != S_STARTING_PAIR_ADV)
-                atm_asm_move(S_TBL_IDX, OP_ADV_TIMEOUT);
-        } break;
-        case ATM_ADV_DELETED: {
-            // If we deleted the pair adv, go into regular beacon mode
-            if(app_env.current_adv_idx == PAIR_ADV_TYPE) {
-                atm_asm_move(S_TBL_IDX, OP_CREATE_LUNCH_ADV);
-            }
+            // Also reported right after creation, before the set was ever on
+            if(!app_env.adv_on[act_to_idx(act_idx)]) break;
+            app_env.adv_on[act_to_idx(act_idx)] = false;
+
+            // While a set is starting, its confirmation sorts out the state
+            APP_STATE s = lunch_fsm_state();
+            if(s == S_ADV_STARTED || s == S_CONNECTED)
+                lunch_fsm_post(OP_ADV_TIMEOUT);
         } break;
         case ATM_ADV_IDLE:
         default: {
@@ -370,13 +609,15 @@ static void adv_state_change(atm_adv_state_t state, uint8_t act_idx, ble_err_cod
  * Results in a state machine transition from S_INIT -> S_IDLE
  * @note Called upon app initialization
  */
-static void lunch_s_init(void)
+__WAKE_PATH static void lunch_s_init(void)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_S_INIT, "lunch_s_init");
 
+#ifndef CFG_LUNCH_BEACON_ONLY
     // Create gatt profile
     lunch_atts_create_prf();
     atm_gap_prf_reg(BLE_ATMPRFS_MODULE_NAME, NULL); 
+#endif
 
     // Assign Random Static ADDR
     // atm_gap_gen_rand_addr(BLE_GAP_STATIC_ADDR);
@@ -389,10 +630,10 @@ static void lunch_s_init(void)
  * @brief Triggers a state machine transition from S_ADV_STARTING -> S_ADV_STARTED
  * @note Called once the advertisement has been created and started
  */
-static void lunch_s_start_on(void)
+__WAKE_PATH static void lunch_s_start_on(void)
 {
-    ATM_LOG(V, "%s", __func__);
-    atm_asm_set_state_op(S_TBL_IDX, S_ADV_STARTED, OP_END);
+    LUNCH_LOG(V, LL_S_START_ON, "lunch_s_start_on");
+    lunch_fsm_set(S_ADV_STARTED, OP_END);
 }
 
 /*
@@ -402,8 +643,25 @@ static void lunch_s_start_on(void)
  */
 static void lunch_s_connected(void)
 {
-    ATM_LOG(V, "%s", __func__);
-    atm_asm_set_state_op(S_TBL_IDX, S_CONNECTED, OP_END);
+    LUNCH_LOG(V, LL_S_CONNECTED, "lunch_s_connected");
+    lunch_fsm_set(S_CONNECTED, OP_END);
+}
+
+/*
+ * @brief Decide what to do once a set went off or the central went away
+ * @note The other set may still be on. Once pairing is over the lunch beacon
+ * is (re)started so the new lunch data can be checked at the gate
+ */
+static void lunch_adv_stopped(void)
+{
+    if(app_env.adv_on[IDX_LUNCH] || app_env.adv_on[IDX_PAIR_ADV]) {
+        lunch_fsm_set(S_ADV_STARTED, OP_END);
+    } else if(app_env.pairing) {
+        app_env.pairing = false;
+        lunch_fsm_post(OP_CREATE_LUNCH_ADV);
+    } else {
+        lunch_fsm_post(OP_SLEEP);
+    }
 }
 
 /*
@@ -412,12 +670,12 @@ static void lunch_s_connected(void)
  */
 static void lunch_s_disconnected(void)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_S_DISCONNECTED, "lunch_s_disconnected");
     
     // LED off indicator
     // lunch_led_blink(LUNCH_LED_OFF);
 
-    atm_asm_move(S_TBL_IDX, OP_SLEEP);
+    lunch_adv_stopped();
 }
 
 /*
@@ -426,139 +684,183 @@ static void lunch_s_disconnected(void)
  */
 static void lunch_s_timeout(void)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_S_TIMEOUT, "lunch_s_timeout");
 
     // LED off indicator
     // lunch_led_blink(LUNCH_LED_OFF);
 
-    if(app_env.current_adv_idx == LUNCH_ADV_TYPE) {
-        atm_asm_move(S_TBL_IDX, OP_SLEEP);
-    } else {
-        atm_asm_move(S_TBL_IDX, OP_DELETE_PAIR_ADV);
-    }
+    lunch_adv_stopped();
 }
 
-static void lunch_s_create_lunch_adv(void)
+__WAKE_PATH static void lunch_s_create_lunch_adv(void)
 {
-    ATM_LOG(V, "%s", __func__);
+    LUNCH_LOG(V, LL_S_CREATE_LUNCH_ADV, "lunch_s_create_lunch_adv");
 
     // Fetch params
     app_env.create[IDX_LUNCH] = atm_adv_create_param_get(IDX_LUNCH);
     app_env.start[IDX_LUNCH] = atm_adv_start_param_get(IDX_LUNCH);
-    app_env.current_adv_idx = LUNCH_ADV_TYPE;
+    app_env.start[IDX_LUNCH]->duration = lunch_adv_learn_duration();
 
-    if(app_env.act_idx[IDX_LUNCH] != ATM_INVALID_ACTIDX) {
-        atm_adv_start(app_env.act_idx[IDX_LUNCH], app_env.start[IDX_LUNCH]);
+    // Spread out tags that were woken by the same WuRX pulse. A warm adv
+    // set already has its dithered interval, it only needs a new offset
+    if(app_env.act_idx[IDX_LUNCH] == ATM_INVALID_ACTIDX) {
+        lunch_adv_ca_apply(app_env.create[IDX_LUNCH]);
+    }
+
+    uint16_t delay = lunch_adv_ca_start_delay();
+    start_delay_cs = delay;
+    if(delay) {
+        LUNCH_LOG(D, LL_ADV_START_DELAY, "Lunch adv start delayed %d0ms", delay);
+        sw_timer_set(lunch_adv_start_tid, delay);
     } else {
-        atm_adv_create(app_env.create[IDX_LUNCH]); // adv_state_change (ATM_ADV_CREATED)
+        lunch_adv_go();
     }
 }
 
+/*
+ * @brief Bring up the pair adv next to whatever is already advertising
+ * @note The lunch adv keeps running, a student pairing in line still gets
+ * counted at the gate
+ */
 static void lunch_s_create_pair_adv(void)
 {
-    ATM_LOG(V, "%s", __func__);
-    
-    // Fetch params
-    app_env.create[IDX_PAIR_ADV] = atm_adv_create_param_get(IDX_PAIR_ADV);
-    app_env.start[IDX_PAIR_ADV] = atm_adv_start_param_get(IDX_PAIR_ADV);
-    app_env.current_adv_idx = PAIR_ADV_TYPE;
+    LUNCH_LOG(V, LL_S_CREATE_PAIR_ADV, "lunch_s_create_pair_adv");
 
-    if(app_env.act_idx[IDX_PAIR_ADV] != ATM_INVALID_ACTIDX) {
-        atm_adv_start(app_env.act_idx[IDX_PAIR_ADV], app_env.start[IDX_PAIR_ADV]);
-    } else {
-        atm_adv_create(app_env.create[IDX_PAIR_ADV]); // adv_state_change (ATM_ADV_CREATED)
+    if(app_env.adv_on[IDX_PAIR_ADV]) {
+        LUNCH_LOG(D, LL_PAIR_ADV_ALREADY_ON, "Pair adv already on");
+        lunch_fsm_set(S_ADV_STARTED, OP_END);
+        return;
     }
-}
 
-static void lunch_s_delete_pair_adv(void)
-{
-    ATM_LOG(V, "%s", __func__);
-
-    atm_adv_delete(app_env.act_idx[IDX_PAIR_ADV]);
-    app_env.act_idx[IDX_PAIR_ADV] = ATM_INVALID_ACTIDX;
+    // Fetch params
+    app_env.create[IDX_PAIR_ADV] = atm_adv_create_param_get(IDX_PAIR_ADV);
+    app_env.start[IDX_PAIR_ADV] = atm_adv_start_param_get(IDX_PAIR_ADV);
+    app_env.pairing = true;
+    lunch_conn_session_start();
 
-    atm_pm_unlock(lock_hiber);
+    adv_set_go(IDX_PAIR_ADV);
 }
 
-static void lunch_s_stop_adv_and_pair(void)
+static void lunch_hibernate(void)
 {
-    ATM_LOG(V, "%s", __func__);
-
-    if(app_env.current_adv_idx == LUNCH_ADV_TYPE) {
-        atm_adv_stop(app_env.act_idx[IDX_LUNCH]);
-        atm_asm_move(S_TBL_IDX, OP_CREATE_PAIR_ADV);
-    } else {
-        // Don't go to idle mode
-        atm_asm_set_state_op(S_TBL_IDX, S_ADV_STARTED, OP_END);
+    lunch_sleep_teardown();
+    warm = false;
+    lunch_wurx_disarm();
+    if(lunch_sched_on_sleep()) {
+        lunch_wurx_tune_window_end();
     }
+    lunch_adv_learn_sleep();
+    lunch_energy_on_sleep();
+    LUNCH_PM_UNLOCK(lock_hiber);
 }
 
 static void lunch_s_sleep(void)
 {
     lunch_led_off();
-    atm_pm_unlock(lock_hiber);
+    lunch_wurx_tune_sleep();
+
+#if CFG_LUNCH_WARM_WINDOW
+    uint32_t since_wake_cs = (atm_get_sys_time() - last_wake_time) / 10000;
+    if(since_wake_cs < CFG_LUNCH_WARM_WINDOW && app_env.act_idx[IDX_LUNCH] != ATM_INVALID_ACTIDX) {
+        // Still in the lunch period, keep the hibernate lock so we only drop
+        // to retention, and listen for the next WuRX wake
+        LUNCH_LOG(D, LL_S_WARM, "Staying warm for %lu0ms", CFG_LUNCH_WARM_WINDOW - since_wake_cs);
+        warm = true;
+        lunch_energy_phase(ENERGY_RETAIN);
+        lunch_wurx_arm();
+        sw_timer_set(warm_tid, CFG_LUNCH_WARM_WINDOW - since_wake_cs);
+        lunch_log_drain();
+        lunch_trace_dump();
+        return;
+    }
+#endif
+
+    lunch_hibernate();
 }
 
-static const state_entry s_tbl[] = {
-    // Initialize module
-    {S_OP(S_INIT, OP_MODULE_INIT), S_IDLE, lunch_s_init},
-    // Create lunch beacon
-    {S_OP(S_IDLE, OP_CREATE_LUNCH_ADV), S_STARTING_LUNCH_ADV, lunch_s_create_lunch_adv},
-    // Create pairing beacon
-    {S_OP(S_INIT, OP_CREATE_PAIR_ADV), S_IDLE, lunch_s_init},
-    {S_OP(S_IDLE, OP_CREATE_PAIR_ADV), S_STARTING_PAIR_ADV, lunch_s_create_pair_adv},
-    // Start the lunch beacon after receiving confirmation
-    {S_OP(S_STARTING_LUNCH_ADV, OP_CREATE_LUNCH_CFM), S_ADV_STARTED, lunch_s_start_on},
-    // Start the pairing beacon after receiving confirmation
-    {S_OP(S_STARTING_PAIR_ADV, OP_CREATE_PAIR_CFM), S_ADV_STARTED, lunch_s_start_on},
-    // Stop adv and move to go into pairing mode
-    {S_OP(S_ADV_STARTED, OP_CREATE_PAIR_ADV), S_IDLE, lunch_s_stop_adv_and_pair},
-    
-    // Handle connections, timeouts, restarts
-    {S_OP(S_ADV_STARTED, OP_CONNECTED), S_CONNECTED, lunch_s_connected},
-    {S_OP(S_CONNECTED, OP_DISCONNECTED), S_ADV_STOPPED, lunch_s_disconnected},
-    {S_OP(S_CONNECTED, OP_ADV_TIMEOUT), S_CONNECTED, lunch_s_connected},
-    {S_OP(S_ADV_STARTED, OP_ADV_TIMEOUT), S_ADV_STOPPED, lunch_s_timeout},
-    {S_OP(S_ADV_STOPPED, OP_DELETE_PAIR_ADV), S_IDLE, lunch_s_delete_pair_adv},
-    {S_OP(S_ADV_STOPPED, OP_SLEEP), S_IDLE, lunch_s_sleep}
+// Transitions are listed in lunch_fsm.def
+static const lunch_fsm_tbl_t s_tbl = {
+#define LUNCH_TRANS(state, op, next, handler) LUNCH_FSM_ENTRY(state, op, next, handler)
+#include "lunch_fsm.def"
+};
+
+// A second transition for the same state and op fails to compile here
+enum {
+#define LUNCH_TRANS(state, op, next, handler) FSM_TRANS_##state##_##op,
+#include "lunch_fsm.def"
 };
 
 __FAST static rep_vec_err_t
 enter_hib(bool *sleep, int32_t duration, uint32_t int_set)
 {
-    ATM_LOG(D, "Entering Hibernation Mode");
+    LUNCH_LOG(D, LL_ENTER_HIB, "Entering Hibernation Mode");
+    LUNCH_TRACE(TR_HIB, 0, 0);
+    lunch_sleep_enter();
+    lunch_log_drain();
+    lunch_trace_dump();
     return RV_NEXT;
 }
 
-static rep_vec_err_t user_appm_init(void)
+__WAKE_PATH static rep_vec_err_t user_appm_init(void)
 {
+    lunch_trace_init();
+    LUNCH_TRACE(TR_BOOT, boot_was_cold(), 0);
+
     // Initialize state machine
-    atm_asm_init_table(S_TBL_IDX, s_tbl, ARRAY_LEN(s_tbl));
-    atm_asm_reg_state_change_cb(S_TBL_IDX, asm_state_change_cb);
-    atm_asm_set_state_op(S_TBL_IDX, S_INIT, OP_END);
+    lunch_fsm_init(&s_tbl, fsm_state_change_cb);
 
     // Setup WuRX
     RV_PLF_PREVENT_HIBERNATION_ADD_LAST(wurx_adv_prevent_hib);
     RV_PLF_HIBERNATE_ADD(enter_hib);
 
     lock_hiber = atm_pm_alloc(PM_LOCK_HIBERNATE);
+    lunch_adv_start_tid = sw_timer_alloc(lunch_adv_start_timer, NULL);
+    warm_tid = sw_timer_alloc(warm_timer, NULL);
+    lunch_sleep_reg_timer(SLEEP_TIMER_ADV_START, lunch_adv_start_tid);
+    lunch_sleep_reg_timer(SLEEP_TIMER_WARM, warm_tid);
+    lunch_conn_init();
+    lunch_ota_init();
+    lunch_wurx_init(wurx_gate_event);
 
     // Check if woken by WuRX or button
     if (!boot_was_cold()) {
-        ATM_LOG(D, "WuRX Boot");
+        LUNCH_LOG(D, LL_WURX_BOOT, "WuRX Boot");
+        last_wake_time = atm_get_sys_time();
+
+        bool timer_wake = lunch_sched_on_wake();
+
+        // Only a held button needs timing, WuRX wakes skip it
+        bool button_wake = lunch_button_on_wake();
+        if(!button_wake && timer_wake) {
+            // Reached a window edge or the sys time wrap guard, pick WuRX and
+            // the timer again and go back without touching the energy record
+            LUNCH_LOG(D, LL_SCHED_TIMER_WAKE, "Schedule Timer Wake");
+            lunch_wurx_tune_timer_wake();
+            lunch_energy_timer_hop();
+            lunch_hibernate();
+            return RV_DONE;
+        }
+
+        // Sample battery before the radio starts drawing current
+        lunch_energy_on_wake();
 
-        // Check if we are pressing button
-        lunch_button_on_wake();
+        if(button_wake) {
+            LUNCH_LOG(D, LL_BUTTON_WAKE, "Button Wake");
+        } else {
+            lunch_wurx_tune_wake();
+            lunch_adv_learn_wake();
+        }
 
         wurx_disable();
-        atm_pm_lock(lock_hiber);
+        LUNCH_PM_LOCK(lock_hiber);
         
         // Move state machine
-        atm_asm_move(S_TBL_IDX, OP_MODULE_INIT);
+        lunch_fsm_post(OP_MODULE_INIT);
     } else {
-        ATM_LOG(D, "Cold Boot");
+        LUNCH_LOG(D, LL_COLD_BOOT, "Cold Boot");
+        lunch_sched_on_wake();
 
-        atm_pm_unlock(lock_hiber);
+        LUNCH_PM_UNLOCK(lock_hiber);
     }
 
 
@@ -572,6 +874,6 @@ int main(void)
 
     RV_APPM_INIT_ADD_LAST(user_appm_init);
 
-    ATM_LOG(D, "user_main() done%s", "");
+    LUNCH_LOG(D, LL_USER_MAIN_DONE, "user_main() done");
     return 0;
 }
\ No newline at end of file
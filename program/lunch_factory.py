@@ -0,0 +1,81 @@
+import argparse
+import os
+
+from lunch_gid import DEFAULT_GID, wurx_gid
+
+# Writes the tds files a BEACON_ONLY build flashes in place of pairing: the
+# lunch data (d0-LUNCH_DATA) and PMU_WURX with the tag's group ID (with
+# --gid, else the default), the same values the tag would store when paired. Must match nvds_lunch_data_t in
+# src/non_bt/lunch_nvds.h and CFG_WURX_GID_OFS in src/cfg_lunch_params.h
+SCHOOL_ID_ARR_LEN = 6
+STUDENT_ID_ARR_LEN = 10
+WURX_GID_OFS = 8
+
+TAG_DATA = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tag_data')
+
+
+def hex_line(data):
+    return ' '.join(f'{b:02x}' for b in data)
+
+
+def id_bytes(value, arr_len, what):
+    raw = value.encode()
+    # Last byte stays 0 so the tag can treat it as a string
+    if len(raw) > arr_len - 1:
+        raise SystemExit(f'{what} is longer than {arr_len - 1} characters')
+    return raw.ljust(arr_len, b'\0')
+
+
+def lunch_data_tds(school_id, student_id, group, gid_on):
+    return (f'# School ID ({SCHOOL_ID_ARR_LEN} bytes) {school_id}\n'
+            f'{hex_line(id_bytes(school_id, SCHOOL_ID_ARR_LEN, "School ID"))}\n\n'
+            f'# Student ID ({STUDENT_ID_ARR_LEN} bytes) {student_id}\n'
+            f'{hex_line(id_bytes(student_id, STUDENT_ID_ARR_LEN, "Student ID"))}\n\n'
+            f'# Group, grade or lunch period (1 byte, 0 = whole school)\n'
+            f'{group:02x}\n\n'
+            f'# WuRX group ID on (1 byte, 0 = keep the default {hex_line(DEFAULT_GID)})\n'
+            f'{int(gid_on):02x}\n')
+
+
+def pmu_wurx_tds(base, gid):
+    # Copy the base tds and only swap the gid bytes, comments and all
+    out = []
+    ofs = 0
+    with open(os.path.join(TAG_DATA, 'b4-PMU_WURX', base + '.tds')) as f:
+        for line in f:
+            data, sep, comment = line.rstrip('\n').partition('#')
+            tokens = data.split()
+            for i in range(len(tokens)):
+                if WURX_GID_OFS <= ofs + i < WURX_GID_OFS + len(gid):
+                    tokens[i] = f'{gid[ofs + i - WURX_GID_OFS]:02x}'
+            ofs += len(tokens)
+            if tokens:
+                line = ' '.join(tokens) + data[len(data.rstrip()):] + sep + comment + '\n'
+            out.append(line)
+    return ''.join(out)
+
+
+def write(tag_dir, name, text):
+    path = os.path.join(TAG_DATA, tag_dir, name + '.tds')
+    with open(path, 'w') as f:
+        f.write(text)
+    print(f'Wrote {os.path.relpath(path)}')
+
+
+parser = argparse.ArgumentParser(description='Tag data for a BEACON_ONLY LunchTrak build, pairing done at the factory')
+parser.add_argument('school_id', help='School ID (up to 5 characters, e.g. GUNN)')
+parser.add_argument('student_id', help='Student ID (up to 9 characters)')
+parser.add_argument('--group', type=int, default=0, choices=range(256),
+                    help='Grade or lunch period, 0 for the whole school')
+parser.add_argument('--name', help='tds file name, defaults to the student ID')
+parser.add_argument('--pmu-wurx', default='high_duty_adv', help='b4-PMU_WURX tds to start from')
+parser.add_argument('--gid', action='store_true',
+                    help="Use the school's WuRX group ID, only once its gates send it (program/lunch_gid.py)")
+args = parser.parse_args()
+
+name = args.name or args.student_id
+gid = wurx_gid(args.school_id, args.group) if args.gid else DEFAULT_GID
+write('d0-LUNCH_DATA', name, lunch_data_tds(args.school_id, args.student_id, args.group, args.gid))
+write('b4-PMU_WURX', name, pmu_wurx_tds(args.pmu_wurx, gid))
+print(f'make run_all BEACON_ONLY=1 LUNCH_DATA={name} PMU_WURX={name}')
+print(f'python tools/energy_model.py makefile:BEACON_ONLY=1,LUNCH_DATA={name},PMU_WURX={name}')
@@ -0,0 +1,32 @@
+import argparse
+import struct
+
+# Must match put_wurx_gid() in src/non_bt/lunch_nvds.c
+SCHOOL_ID_LEN = 5  # SCHOOL_ID_ARR_LEN - 1
+DEFAULT_GID = bytes([0xaa] * 4)
+
+
+def fnv1a(data, h=0x811c9dc5):
+    for b in data:
+        h = ((h ^ b) * 0x01000193) & 0xffffffff
+    return h
+
+
+def wurx_gid(school_id, group=0):
+    if not school_id:
+        return DEFAULT_GID
+    h = fnv1a(school_id.encode()[:SCHOOL_ID_LEN])
+    if group:
+        h = fnv1a([group], h)
+    return struct.pack('<I', h)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='WuRX group ID a gate must send to wake a school or group')
+    parser.add_argument('school_id', help='School ID as provisioned (e.g. GUNN)')
+    parser.add_argument('--group', type=int, default=0, choices=range(256),
+                        help='Grade or lunch period, 0 for the whole school')
+    args = parser.parse_args()
+
+    gid = wurx_gid(args.school_id, args.group)
+    print(' '.join(f'{b:02x}' for b in gid) + '\t# wurx0_gid')
@@ -0,0 +1,66 @@
+import argparse
+import datetime
+import struct
+
+# Must match lunch_window_t / nvds_lunch_sched_t in src/non_bt/lunch_sched.h
+MAX_WINDOWS = 8
+WINDOW_FMT = '<BHH'
+DAYS = ['mon', 'tue', 'wed', 'thu', 'fri', 'sat', 'sun']
+
+
+def parse_days(text):
+    mask = 0
+    for part in text.lower().split(','):
+        if '-' in part:
+            first, last = (DAYS.index(d) for d in part.split('-'))
+            for d in range(first, last + 1):
+                mask |= 1 << d
+        else:
+            mask |= 1 << DAYS.index(part)
+    return mask
+
+
+def parse_minutes(text):
+    h, m = text.split(':')
+    return int(h) * 60 + int(m)
+
+
+def parse_window(text):
+    # "mon-fri 11:30-12:15"
+    days, times = text.split()
+    start, end = (parse_minutes(t) for t in times.split('-'))
+    if not start < end <= 24 * 60:
+        raise argparse.ArgumentTypeError(f'bad window {text}')
+    return parse_days(days), start, end
+
+
+def schedule(args):
+    if len(args.window) > MAX_WINDOWS:
+        raise SystemExit(f'At most {MAX_WINDOWS} windows')
+    # Value to write to the schedule characteristic
+    payload = bytes([len(args.window)])
+    for days, start, end in args.window:
+        payload += struct.pack(WINDOW_FMT, days, start, end)
+    print(payload.hex())
+
+
+def time_of_week(args):
+    now = datetime.datetime.now() + datetime.timedelta(seconds=args.offset)
+    week_s = now.weekday() * 86400 + now.hour * 3600 + now.minute * 60 + now.second
+    # Value to write to the time characteristic
+    print(struct.pack('<I', week_s).hex())
+
+
+parser = argparse.ArgumentParser(description='LunchTrak lunch window schedule')
+sub = parser.add_subparsers(required=True)
+
+p = sub.add_parser('schedule', help='Encode the weekly lunch windows')
+p.add_argument('window', nargs='*', type=parse_window, help='e.g. "mon-fri 11:30-12:15"')
+p.set_defaults(func=schedule)
+
+p = sub.add_parser('time', help='Encode the local time of week')
+p.add_argument('--offset', type=int, default=0, help='Seconds to add for the write latency')
+p.set_defaults(func=time_of_week)
+
+args = parser.parse_args()
+args.func(args)
@@ -0,0 +1,82 @@
+import argparse
+import csv
+import hashlib
+import hmac
+import os
+
+# Must match LUNCH_TOKEN_LEN and LUNCH_TOKEN_BATCH_LEN in src/non_bt/lunch_nvds.h
+TOKEN_LEN = 16
+BATCH_LEN = 16
+
+# Gate side lookup table: token -> school, student, batch, index
+FIELDS = ['token', 'school_id', 'student_id', 'batch', 'index']
+
+
+def make_tokens(secret, school_id, student_id, batch, count):
+    # HMAC so tokens can't be linked without the school's secret
+    tokens = []
+    for i in range(count):
+        msg = f'{school_id}|{student_id}|{batch}|{i}'.encode()
+        tokens.append(hmac.new(secret, msg, hashlib.sha256).digest()[:TOKEN_LEN])
+    return tokens
+
+
+def load_table(path):
+    if not os.path.exists(path):
+        return {}
+    with open(path, newline='') as f:
+        return {row['token']: row for row in csv.DictReader(f)}
+
+
+def gen(args):
+    with open(args.secret, 'rb') as f:
+        secret = f.read().strip()
+
+    tokens = make_tokens(secret, args.school_id, args.student_id, args.batch, args.count)
+
+    # Drop the old batch for this student so the gate stops resolving it
+    table = load_table(args.table)
+    table = {k: v for k, v in table.items()
+             if (v['school_id'], v['student_id']) != (args.school_id, args.student_id)}
+    for i, t in enumerate(tokens):
+        table[t.hex()] = {'token': t.hex(), 'school_id': args.school_id,
+                          'student_id': args.student_id, 'batch': args.batch, 'index': i}
+
+    with open(args.table, 'w', newline='') as f:
+        w = csv.DictWriter(f, fieldnames=FIELDS)
+        w.writeheader()
+        w.writerows(table.values())
+
+    # Value to write to the tokens characteristic (nvds_lunch_tokens_t)
+    payload = bytes([args.batch & 0xff, len(tokens)]) + b''.join(tokens)
+    print(payload.hex())
+
+
+def resolve(args):
+    table = load_table(args.table)
+    row = table.get(args.token.lower())
+    if row is None:
+        print('Unknown token (cleartext lunch data?)')
+    else:
+        print(f"School ID: {row['school_id']} - Student ID: {row['student_id']} "
+              f"(batch {row['batch']}, token {row['index']})")
+
+
+parser = argparse.ArgumentParser(description='LunchTrak rotating token tables')
+parser.add_argument('--table', default='lunch_tokens.csv', help='Gate lookup table')
+sub = parser.add_subparsers(required=True)
+
+p = sub.add_parser('gen', help='Generate a token batch for one tag')
+p.add_argument('--secret', required=True, help='File with the school token secret')
+p.add_argument('--batch', type=int, default=0)
+p.add_argument('--count', type=int, default=BATCH_LEN, choices=range(1, BATCH_LEN + 1))
+p.add_argument('school_id')
+p.add_argument('student_id')
+p.set_defaults(func=gen)
+
+p = sub.add_parser('resolve', help='Look up a token seen by the gate')
+p.add_argument('token', help='16 byte token in hex')
+p.set_defaults(func=resolve)
+
+args = parser.parse_args()
+args.func(args)
@@ -0,0 +1,117 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_adv_ca.c
+ *
+ * @brief Lunch Adv Collision Avoidance
+ *
+ * All tags in line are woken by the same WuRX pulse and would otherwise start
+ * ADV0 in lockstep. Each tag gets a random start offset per wake and a fixed
+ * interval offset derived from its BD address so the packets drift apart.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#include "arch.h"
+#include "atm_log.h"
+#include "timer.h"
+
+#ifdef GAP_ADV_PARM_NAME
+#include STR(GAP_ADV_PARM_NAME)
+#endif
+
+#include "lunch_adv_ca.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_wake.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_adv_ca", V);
+
+#define BLE_ADDR_LEN 6
+#define MS_TO_SLOTS(ms) ((uint32_t)(ms) * 1000 / 625)
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static uint32_t dev_seed;
+static uint32_t rand_state;
+
+#if CFG_ADV0_CA_CHMAP_ROTATE
+static uint8_t const chmap_subsets[] = {CFG_ADV0_CA_CHMAP_SUBSETS};
+#endif
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+// FNV-1a, good enough to spread sequential BD addresses
+static uint32_t hash_addr(uint8_t const *addr, uint8_t len)
+{
+    uint32_t h = 0x811c9dc5;
+    for (uint8_t i = 0; i < len; i++) {
+        h ^= addr[i];
+        h *= 0x01000193;
+    }
+    return h;
+}
+
+// xorshift32
+__WAKE_PATH static uint32_t next_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_adv_ca_init(void)
+{
+    uint8_t addr[BLE_ADDR_LEN] = {0};
+    nvds_tag_len_t len = BLE_ADDR_LEN;
+    nvds_get_ble_addr(addr, &len);
+
+    dev_seed = hash_addr(addr, BLE_ADDR_LEN);
+
+    // Sys time differs a little per tag after wakeup, mix it in so the start
+    // offset is not the same on every wake
+    rand_state = dev_seed ^ atm_get_sys_time();
+    if (!rand_state) {
+        rand_state = 0x2545f491;
+    }
+
+    LUNCH_LOG(V, LL_CA_SEED, "lunch_adv_ca_init: seed=%#lx", dev_seed);
+}
+
+__WAKE_PATH void lunch_adv_ca_apply(atm_adv_create_t *create)
+{
+#if CFG_ADV0_CA_ENABLE
+    uint32_t dither = dev_seed % (MS_TO_SLOTS(CFG_ADV0_CA_INTERVAL_DITHER_MS) + 1);
+    create->adv_param.prim_cfg.adv_intv_min = CFG_ADV0_CREATE_INTERVAL_MIN + dither;
+    create->adv_param.prim_cfg.adv_intv_max = CFG_ADV0_CREATE_INTERVAL_MAX + dither;
+
+#if CFG_ADV0_CA_CHMAP_ROTATE
+    create->adv_param.prim_cfg.ch_map = chmap_subsets[next_rand() % ARRAY_LEN(chmap_subsets)];
+#endif
+
+    LUNCH_LOG(D, LL_CA_APPLY, "lunch_adv_ca_apply: intv=%lu ch_map=%#x",
+        create->adv_param.prim_cfg.adv_intv_min, create->adv_param.prim_cfg.ch_map);
+#endif
+}
+
+__WAKE_PATH uint16_t lunch_adv_ca_start_delay(void)
+{
+#if CFG_ADV0_CA_ENABLE
+    return next_rand() % (CFG_ADV0_CA_START_JITTER_MAX + 1);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,40 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_adv_ca.h
+ *
+ * @brief Lunch Adv Collision Avoidance
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include <inttypes.h>
+#include "atm_adv_param.h"
+
+/**
+ *******************************************************************************
+ * @brief Seed the per device dither and per wake randomness from the BD address
+ * @note Call once per wake before the lunch adv is created
+ *******************************************************************************
+ */
+void lunch_adv_ca_init(void);
+
+/**
+ *******************************************************************************
+ * @brief Apply the interval dither and channel subset to the lunch adv params
+ *
+ * @param[in,out] create  Lunch adv create params (must not be const)
+ *******************************************************************************
+ */
+void lunch_adv_ca_apply(atm_adv_create_t *create);
+
+/**
+ *******************************************************************************
+ * @brief Random delay before starting the lunch adv after wakeup
+ * @returns Delay in units of 10ms, 0 if collision avoidance is disabled
+ *******************************************************************************
+ */
+uint16_t lunch_adv_ca_start_delay(void);
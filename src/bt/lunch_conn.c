@@ -0,0 +1,180 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_conn.c
+ *
+ * @brief Connection guard for pairing
+ *
+ * Only one central at a time, optionally only provisioning stations from
+ * the accept list. A central that goes quiet is disconnected after
+ * CFG_LUNCH_CONN_IDLE_CS, and all connections of one pairing session
+ * together get CFG_LUNCH_CONN_SESSION_CS. Without this, a phone that never
+ * disconnects keeps the tag awake until the battery is gone.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <string.h>
+#include "arch.h"
+#include "atm_gap.h"
+#include "atm_log.h"
+#include "sw_timer.h"
+#include "timer.h"
+#include "nvds.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_conn.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_sleep.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_conn", V);
+
+#define CONN_NONE 0xFF
+#define BD_ADDR_LEN 6
+// Remote user terminated connection
+#define CONN_DISC_REASON 0x13
+
+typedef enum {
+    CONN_OK,
+    CONN_BUSY,
+    CONN_SESSION_OVER,
+    CONN_NOT_LISTED,
+} conn_verdict_t;
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static sw_timer_id_t idle_tid;
+static sw_timer_id_t session_tid;
+static uint8_t active = CONN_NONE;
+static bool active_listed;
+static uint32_t connect_time;
+static uint32_t session_left_cs = CFG_LUNCH_CONN_SESSION_CS;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+static void conn_drop(uint8_t conidx)
+{
+    atm_gap_disconnect(conidx, CONN_DISC_REASON);
+}
+
+static void idle_timer(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(idle_tid);
+    if (active == CONN_NONE) {
+        return;
+    }
+
+    LUNCH_LOG(D, LL_CONN_IDLE, "Central idle for %d0ms, disconnecting", CFG_LUNCH_CONN_IDLE_CS);
+    conn_drop(active);
+}
+
+static void session_timer(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(session_tid);
+    if (active == CONN_NONE) {
+        return;
+    }
+
+    LUNCH_LOG(D, LL_CONN_SESSION_OVER, "Pairing session used up, disconnecting");
+    conn_drop(active);
+}
+
+// listed is only set when a list is provisioned and the peer is on it
+static bool in_accept_list(uint8_t const *peer_addr, bool *listed)
+{
+    *listed = false;
+    uint8_t list[CFG_LUNCH_CONN_ACCEPT_MAX * BD_ADDR_LEN];
+    nvds_tag_len_t len = sizeof(list);
+    if (nvds_get_conn_accept(list, &len) != NVDS_OK || !len) {
+        // No list provisioned, anyone may pair
+        return true;
+    }
+
+    for (nvds_tag_len_t ofs = 0; ofs + BD_ADDR_LEN <= len; ofs += BD_ADDR_LEN) {
+        if (!memcmp(&list[ofs], peer_addr, BD_ADDR_LEN)) {
+            *listed = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_conn_init(void)
+{
+    idle_tid = sw_timer_alloc(idle_timer, NULL);
+    session_tid = sw_timer_alloc(session_timer, NULL);
+    lunch_sleep_reg_timer(SLEEP_TIMER_CONN_IDLE, idle_tid);
+    lunch_sleep_reg_timer(SLEEP_TIMER_CONN_SESSION, session_tid);
+}
+
+void lunch_conn_session_start(void)
+{
+    session_left_cs = CFG_LUNCH_CONN_SESSION_CS;
+}
+
+bool lunch_conn_accept(uint8_t conidx, uint8_t const *peer_addr)
+{
+    conn_verdict_t verdict = CONN_OK;
+    bool listed = false;
+    if (active != CONN_NONE) {
+        verdict = CONN_BUSY;
+    } else if (!session_left_cs) {
+        verdict = CONN_SESSION_OVER;
+    } else if (!in_accept_list(peer_addr, &listed)) {
+        verdict = CONN_NOT_LISTED;
+    }
+
+    if (verdict != CONN_OK) {
+        LUNCH_LOG(D, LL_CONN_REJECT, "Refusing conidx %d, reason %d", conidx, verdict);
+        conn_drop(conidx);
+        return false;
+    }
+
+    active = conidx;
+    active_listed = listed;
+    connect_time = atm_get_sys_time();
+    sw_timer_set(idle_tid, CFG_LUNCH_CONN_IDLE_CS);
+    sw_timer_set(session_tid, session_left_cs);
+    return true;
+}
+
+void lunch_conn_activity(void)
+{
+    if (active != CONN_NONE) {
+        sw_timer_set(idle_tid, CFG_LUNCH_CONN_IDLE_CS);
+    }
+}
+
+bool lunch_conn_listed(void)
+{
+    return active != CONN_NONE && active_listed;
+}
+
+bool lunch_conn_closed(uint8_t conidx)
+{
+    if (conidx != active) {
+        return false;
+    }
+
+    sw_timer_clear(idle_tid);
+    sw_timer_clear(session_tid);
+    active = CONN_NONE;
+
+    uint32_t used_cs = (atm_get_sys_time() - connect_time) / 10000;
+    session_left_cs = used_cs < session_left_cs ? session_left_cs - used_cs : 0;
+    return true;
+}
@@ -0,0 +1,80 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_conn.h
+ *
+ * @brief Connection guard for pairing
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#ifndef CFG_LUNCH_BEACON_ONLY
+
+/**
+ *******************************************************************************
+ * @brief Allocate the idle and session timers
+ *******************************************************************************
+ */
+void lunch_conn_init(void);
+
+/**
+ *******************************************************************************
+ * @brief A new pairing session started, give it the full connected time
+ * @note Call when the pair adv is started by the button
+ *******************************************************************************
+ */
+void lunch_conn_session_start(void);
+
+/**
+ *******************************************************************************
+ * @brief Decide if a new connection may stay
+ * @note A refused connection is disconnected here, its disc_ind will not be
+ * ours
+ *
+ * @param[in] conidx     Connection index
+ * @param[in] peer_addr  6 byte address of the central
+ * @returns true if the connection is accepted
+ *******************************************************************************
+ */
+bool lunch_conn_accept(uint8_t conidx, uint8_t const *peer_addr);
+
+/**
+ *******************************************************************************
+ * @brief The central read or wrote something, restart the idle timeout
+ *******************************************************************************
+ */
+void lunch_conn_activity(void);
+
+/**
+ *******************************************************************************
+ * @brief Is the accepted central on a provisioned accept list
+ * @note false without a list, when any central may pair
+ *******************************************************************************
+ */
+bool lunch_conn_listed(void);
+
+/**
+ *******************************************************************************
+ * @brief A connection went away
+ * @returns true if it was the accepted one
+ *******************************************************************************
+ */
+bool lunch_conn_closed(uint8_t conidx);
+
+#else
+
+// Nothing is connectable in a beacon only build
+static inline void lunch_conn_init(void) {}
+static inline void lunch_conn_session_start(void) {}
+static inline bool lunch_conn_accept(uint8_t conidx, uint8_t const *peer_addr) { return false; }
+static inline void lunch_conn_activity(void) {}
+static inline bool lunch_conn_listed(void) { return false; }
+static inline bool lunch_conn_closed(uint8_t conidx) { return false; }
+
+#endif // CFG_LUNCH_BEACON_ONLY
@@ -25,6 +25,10 @@
 
 #include "lunch_gatt.h"
 #include "lunch_nvds.h"
+#include "lunch_energy.h"
+#include "lunch_sched.h"
+#include "lunch_conn.h"
+#include "lunch_ota.h"
 
 ATM_LOG_LOCAL_SETTING("lunch_gatt", V);
 
@@ -68,10 +72,62 @@ static void try_write_school_data(uint8_t const *data, uint8_t len)
 		school_id[i] = 0;
 
 	// TODO: Add some more checks, like ascii characters only?
-	nvds_put_student_data(school_id);
+	nvds_put_school_data(school_id);
 
 }
 
+static void try_write_group_data(uint8_t const *data, uint16_t len)
+{
+	// group, then optionally the WuRX group ID switch
+	if(len != 1 && len != 2) {
+		ATM_LOG(W, "Cannot write group, bad length %d", len);
+		return;
+	}
+
+	nvds_put_group_data(data, len);
+}
+
+#ifdef CFG_LUNCH_TOKENS
+static void try_write_tokens(uint8_t const *data, uint16_t len)
+{
+	// batch, count, then count tokens
+	if(len < 2 || data[1] > LUNCH_TOKEN_BATCH_LEN || len != 2 + data[1] * LUNCH_TOKEN_LEN) {
+		ATM_LOG(W, "Cannot write lunch tokens, bad length %d", len);
+		return;
+	}
+
+	nvds_lunch_tokens_t tokens = {0};
+	memcpy(&tokens, data, len);
+	nvds_put_lunch_tokens(&tokens);
+}
+#endif
+
+static void try_write_schedule(uint8_t const *data, uint16_t len)
+{
+	// count, then count windows
+	if(len < 1 || data[0] > LUNCH_SCHED_MAX_WINDOWS || len != 1 + data[0] * sizeof(lunch_window_t)) {
+		ATM_LOG(W, "Cannot write lunch schedule, bad length %d", len);
+		return;
+	}
+
+	nvds_lunch_sched_t sched = {0};
+	memcpy(&sched, data, len);
+	lunch_sched_set(&sched);
+}
+
+static void try_write_time(uint8_t const *data, uint16_t len)
+{
+	// Local seconds since Monday 00:00, little endian
+	uint32_t week_s;
+	if(len != sizeof(week_s)) {
+		ATM_LOG(W, "Cannot write time, bad length %d", len);
+		return;
+	}
+
+	memcpy(&week_s, data, len);
+	lunch_sched_set_time(week_s);
+}
+
 /*
  * SERVICE CALLBACKS
  *******************************************************************************
@@ -84,6 +140,7 @@ static void try_write_school_data(uint8_t const *data, uint8_t len)
 static uint8_t atts_read_req(uint8_t conidx, uint8_t att_idx)
 {
     ATM_LOG(D, "%s: att_idx (%d)", __func__, att_idx);
+	lunch_conn_activity();
 
 	// Requesting ble addr
 	if (att_idx == atts_attr_handle[ATTS_CHAR_R_BLE_ADDR]) {
@@ -96,6 +153,35 @@ static uint8_t atts_read_req(uint8_t conidx, uint8_t att_idx)
 		ble_atmprfs_gattc_read_cfm(conidx, att_idx, addr, len);
 	}
 
+	// Requesting battery and energy counters
+	if (att_idx == atts_attr_handle[ATTS_CHAR_R_ENERGY]) {
+		ATM_LOG(D, "Send read response for energy");
+		ble_atmprfs_gattc_read_cfm(conidx, att_idx, (uint8_t const *) lunch_energy_get(), sizeof(nvds_energy_t));
+		return ATT_ERR_NO_ERROR;
+	}
+
+	// Requesting lunch schedule and time of week
+	if (att_idx == atts_attr_handle[ATTS_CHAR_RW_SCHEDULE]) {
+		nvds_lunch_sched_t const *sched = lunch_sched_get();
+		ble_atmprfs_gattc_read_cfm(conidx, att_idx, (uint8_t const *) sched,
+			1 + sched->count * sizeof(lunch_window_t));
+		return ATT_ERR_NO_ERROR;
+	}
+	if (att_idx == atts_attr_handle[ATTS_CHAR_RW_TIME]) {
+		uint32_t week_s = lunch_sched_get_time();
+		ble_atmprfs_gattc_read_cfm(conidx, att_idx, (uint8_t const *) &week_s, sizeof(week_s));
+		return ATT_ERR_NO_ERROR;
+	}
+
+#ifdef CFG_LUNCH_OTA
+	// Requesting OTA transfer status, where to go on from
+	if (att_idx == atts_attr_handle[ATTS_CHAR_RW_OTA_CTRL]) {
+		ble_atmprfs_gattc_read_cfm(conidx, att_idx, (uint8_t const *) lunch_ota_status(),
+			sizeof(lunch_ota_status_t));
+		return ATT_ERR_NO_ERROR;
+	}
+#endif
+
 	// Requesting lunch data
 	nvds_lunch_data_t lunch_data = {};
 	nvds_get_lunch_data(&lunch_data);
@@ -106,6 +192,10 @@ static uint8_t atts_read_req(uint8_t conidx, uint8_t att_idx)
 	} else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_STUDENT_ID]) {
 		ATM_LOG(D, "Send read response: %s", lunch_data.student_id);
 		ble_atmprfs_gattc_read_cfm(conidx, att_idx, lunch_data.student_id, STUDENT_ID_ARR_LEN - 1);
+	} else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_GROUP]) {
+		ATM_LOG(D, "Send read response: group %d gid %d", lunch_data.group, lunch_data.gid_on);
+		ble_atmprfs_gattc_read_cfm(conidx, att_idx, &lunch_data.group,
+			sizeof(lunch_data.group) + sizeof(lunch_data.gid_on));
 	}
 
 	return ATT_ERR_NO_ERROR;
@@ -116,6 +206,18 @@ static uint8_t atts_read_req(uint8_t conidx, uint8_t att_idx)
  */
 static uint8_t atts_write_req(uint8_t conidx, uint8_t att_idx, uint8_t const *data, uint16_t len)
 {
+	lunch_conn_activity();
+
+#ifdef CFG_LUNCH_OTA
+	// Binary and frequent, keep it out of the log
+	if (att_idx == atts_attr_handle[ATTS_CHAR_W_OTA_DATA]) {
+		return lunch_ota_data(data, len) ? ATT_ERR_NO_ERROR : ATT_ERR_APP_ERROR;
+	}
+	if (att_idx == atts_attr_handle[ATTS_CHAR_RW_OTA_CTRL]) {
+		return lunch_ota_ctrl(data, len) ? ATT_ERR_NO_ERROR : ATT_ERR_APP_ERROR;
+	}
+#endif
+
 	ATM_LOG(D, "%s: conidx(%d) att_idx (%d)", __func__, conidx, att_idx);
 	ATM_LOG(D, "Write request: %s", data);
 
@@ -124,6 +226,18 @@ static uint8_t atts_write_req(uint8_t conidx, uint8_t att_idx, uint8_t const *da
 		try_write_school_data(data, len);
 	} else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_STUDENT_ID]) {
 		try_write_student_data(data, len);
+	} else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_GROUP]) {
+		try_write_group_data(data, len);
+	}
+#ifdef CFG_LUNCH_TOKENS
+	else if (att_idx == atts_attr_handle[ATTS_CHAR_W_TOKENS]) {
+		try_write_tokens(data, len);
+	}
+#endif
+	else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_SCHEDULE]) {
+		try_write_schedule(data, len);
+	} else if (att_idx == atts_attr_handle[ATTS_CHAR_RW_TIME]) {
+		try_write_time(data, len);
 	}
 
 	return ATT_ERR_NO_ERROR;
@@ -176,6 +290,31 @@ void lunch_atts_create_prf(void)
 	ATTS_RW_SEC_PROPERTY, ATTS_DATA_SIZE);
 	atts_attr_handle[ATTS_CHAR_R_BLE_ADDR] = ble_atmprfs_add_char(char_ble_addr_uuid,
 	BLE_ATT_READ_NO_SECURITY, ATTS_DATA_SIZE);
+	uint8_t char_group_uuid[ATT_UUID_128_LEN] = {CHAR_GROUP_UUID};
+	atts_attr_handle[ATTS_CHAR_RW_GROUP] = ble_atmprfs_add_char(char_group_uuid,
+	ATTS_RW_SEC_PROPERTY, ATTS_DATA_SIZE);
+#ifdef CFG_LUNCH_TOKENS
+	uint8_t char_tokens_uuid[ATT_UUID_128_LEN] = {CHAR_TOKENS_UUID};
+	atts_attr_handle[ATTS_CHAR_W_TOKENS] = ble_atmprfs_add_char(char_tokens_uuid,
+	BLE_ATT_WRITE_REQ_NO_SECURITY, ATTS_DATA_SIZE);
+#endif
+	uint8_t char_energy_uuid[ATT_UUID_128_LEN] = {CHAR_ENERGY_UUID};
+	atts_attr_handle[ATTS_CHAR_R_ENERGY] = ble_atmprfs_add_char(char_energy_uuid,
+	BLE_ATT_READ_NO_SECURITY, ATTS_DATA_SIZE);
+	uint8_t char_schedule_uuid[ATT_UUID_128_LEN] = {CHAR_SCHEDULE_UUID};
+	atts_attr_handle[ATTS_CHAR_RW_SCHEDULE] = ble_atmprfs_add_char(char_schedule_uuid,
+	ATTS_RW_SEC_PROPERTY, ATTS_DATA_SIZE);
+	uint8_t char_time_uuid[ATT_UUID_128_LEN] = {CHAR_TIME_UUID};
+	atts_attr_handle[ATTS_CHAR_RW_TIME] = ble_atmprfs_add_char(char_time_uuid,
+	ATTS_RW_SEC_PROPERTY, ATTS_DATA_SIZE);
+#ifdef CFG_LUNCH_OTA
+	uint8_t char_ota_ctrl_uuid[ATT_UUID_128_LEN] = {CHAR_OTA_CTRL_UUID};
+	atts_attr_handle[ATTS_CHAR_RW_OTA_CTRL] = ble_atmprfs_add_char(char_ota_ctrl_uuid,
+	ATTS_RW_SEC_PROPERTY, ATTS_DATA_SIZE);
+	uint8_t char_ota_data_uuid[ATT_UUID_128_LEN] = {CHAR_OTA_DATA_UUID};
+	atts_attr_handle[ATTS_CHAR_W_OTA_DATA] = ble_atmprfs_add_char(char_ota_data_uuid,
+	BLE_ATT_WRITE_REQ_NO_SECURITY, ATTS_DATA_SIZE);
+#endif
 	atts_attr_handle[ATTS_CHAR_CCCD] = ble_atmprfs_add_client_char_cfg();
 
 	ATM_LOG(D, "%s: SVC (%d), RW_STUDENT_ID (%d), RW_SCHOOL_ID (%d) R_BLE_ADDR (%d) CCCD (%d)", __func__,
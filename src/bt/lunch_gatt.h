@@ -21,6 +21,17 @@ enum atts_attr_idx {
     ATTS_CHAR_RW_STUDENT_ID,
     ATTS_CHAR_RW_SCHOOL_ID,
     ATTS_CHAR_R_BLE_ADDR,
+    ATTS_CHAR_RW_GROUP,
+#ifdef CFG_LUNCH_TOKENS
+    ATTS_CHAR_W_TOKENS,
+#endif
+    ATTS_CHAR_R_ENERGY,
+    ATTS_CHAR_RW_SCHEDULE,
+    ATTS_CHAR_RW_TIME,
+#ifdef CFG_LUNCH_OTA
+    ATTS_CHAR_RW_OTA_CTRL,
+    ATTS_CHAR_W_OTA_DATA,
+#endif
     ATTS_CHAR_CCCD,
 
     ATTS_ATTR_NUM
@@ -44,6 +55,27 @@ enum atts_attr_idx {
 // 44c50732-05a3-4a4b-a9ca-2a13fec120c6
 #define CHAR_BLE_ADDR_UUID 0x44, 0xc5, 0x07, 0x32, 0x05, 0xa3, 0x4a, 0x4b, 0xa9, 0xca, 0x2a, 0x13, 0xfe, 0xc1, 0x20, 0xc6
 
+// 99051ad4-bf61-4da2-9e5c-7091b2d35f68
+#define CHAR_GROUP_UUID 0x99, 0x05, 0x1a, 0xd4, 0xbf, 0x61, 0x4d, 0xa2, 0x9e, 0x5c, 0x70, 0x91, 0xb2, 0xd3, 0x5f, 0x68
+
+// 55a1c3e0-7b2d-4f6e-9a18-3c5d7e9f1b24
+#define CHAR_TOKENS_UUID 0x55, 0xa1, 0xc3, 0xe0, 0x7b, 0x2d, 0x4f, 0x6e, 0x9a, 0x18, 0x3c, 0x5d, 0x7e, 0x9f, 0x1b, 0x24
+
+// 66d2e4a1-8c3e-4a7f-8b29-4d6e8fa02c35
+#define CHAR_ENERGY_UUID 0x66, 0xd2, 0xe4, 0xa1, 0x8c, 0x3e, 0x4a, 0x7f, 0x8b, 0x29, 0x4d, 0x6e, 0x8f, 0xa0, 0x2c, 0x35
+
+// 77e3f5b2-9d4f-4b80-9c3a-5e7f90b13d46
+#define CHAR_SCHEDULE_UUID 0x77, 0xe3, 0xf5, 0xb2, 0x9d, 0x4f, 0x4b, 0x80, 0x9c, 0x3a, 0x5e, 0x7f, 0x90, 0xb1, 0x3d, 0x46
+
+// 88f406c3-ae50-4c91-8d4b-6f80a1c24e57
+#define CHAR_TIME_UUID 0x88, 0xf4, 0x06, 0xc3, 0xae, 0x50, 0x4c, 0x91, 0x8d, 0x4b, 0x6f, 0x80, 0xa1, 0xc2, 0x4e, 0x57
+
+// aa17b8d4-bf61-4da2-9e5c-8e0f12a35b68
+#define CHAR_OTA_CTRL_UUID 0xaa, 0x17, 0xb8, 0xd4, 0xbf, 0x61, 0x4d, 0xa2, 0x9e, 0x5c, 0x8e, 0x0f, 0x12, 0xa3, 0x5b, 0x68
+
+// bb28c9e5-c072-4eb3-af6d-9f1023b46c79
+#define CHAR_OTA_DATA_UUID 0xbb, 0x28, 0xc9, 0xe5, 0xc0, 0x72, 0x4e, 0xb3, 0xaf, 0x6d, 0x9f, 0x10, 0x23, 0xb4, 0x6c, 0x79
+
 /**
  *******************************************************************************
  * @brief Create application specific gatt service
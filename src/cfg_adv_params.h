@@ -29,7 +29,32 @@
     '9', '5', '0', '0', '0', '0', '0', '0', 0x00, 0x00
     
 #define CFG_ADV0_DATA_SCANRSP_PAYLOAD \
-    0x09,0xff,0x00,0x60,'L','U','N','C','H','B'
+    0x0e,0xff,0x00,0x60,'L','U','N','C','H','B', \
+    /* Battery voltage (unit of CFG_ENERGY_VBAT_STEP_MV), set on wake */ \
+    0x00, \
+    /* Wake count (little endian), start delay and warm restart (4 bits */ \
+    /* each) and adv interval in ms, set on wake, see tools/gate_link.py */ \
+    0x00, 0x00, 0x00, 0x00
+
+/*
+ * ADV0 Collision Avoidance
+ * Every tag in line wakes from the same WuRX pulse, so spread them out
+ *******************************************************************************
+ */
+
+// Set to 0 to start ADV0 right away on the fixed interval and channel map
+#define CFG_ADV0_CA_ENABLE 1
+
+// Random delay before the first packet after wakeup (unit of 10ms)
+#define CFG_ADV0_CA_START_JITTER_MAX 10 // 0-100ms
+
+// Per device interval offset seeded from the BD address (0 to N ms added)
+#define CFG_ADV0_CA_INTERVAL_DITHER_MS 15
+
+// Rotate through a 2 channel subset on each wake instead of using all 3
+// Gate scanners still listen on 37/38/39, so every subset is heard
+#define CFG_ADV0_CA_CHMAP_ROTATE 0
+#define CFG_ADV0_CA_CHMAP_SUBSETS 0x03, 0x06, 0x05 // 37+38, 38+39, 37+39
 
 /*
  * ADV1 (Pairing Mode)
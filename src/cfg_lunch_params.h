@@ -0,0 +1,179 @@
+#pragma once
+
+/*
+ * Energy Model
+ * Average current per phase, used to turn time into charge
+ * Measure on the bench for a given board and battery
+ *******************************************************************************
+ */
+
+#define CFG_ENERGY_BOOT_UA 2500       // Boot until the state machine starts
+#define CFG_ENERGY_GAP_INIT_UA 3000   // GAP start, adv create and set data
+#define CFG_ENERGY_ADV_IDLE_UA 15     // Sleeping between adv events
+#define CFG_ENERGY_ADV_EVENT_NC 6000  // One adv event on 3 channels at 0dBm (unit of nC)
+#define CFG_ENERGY_CONNECTED_UA 250   // Connected to a phone while pairing
+#define CFG_ENERGY_RETAIN_UA 4        // Retention with GAP and the lunch adv kept warm
+#define CFG_ENERGY_HIB_NA 1200        // Hibernation with WuRX listening (unit of nA)
+
+// Reported battery voltage byte in the scan response is vbat / 20mV
+#define CFG_ENERGY_VBAT_STEP_MV 20
+
+/*
+ * Lunch Period
+ *******************************************************************************
+ */
+
+// After a WuRX wake, sleep in retention instead of hibernation for this long.
+// GAP and the lunch adv stay created, so another wake in the same lunch
+// period restarts adv right away. 0 to always hibernate (unit of 10ms)
+#define CFG_LUNCH_WARM_WINDOW 60000 // 10 min
+
+/*
+ * Lunch Schedule
+ *******************************************************************************
+ */
+
+// Listen this long before and after every window. A drifting clock still
+// hears the gate there and gets pulled back (unit of minutes)
+#define CFG_LUNCH_SCHED_GUARD_MIN 10
+
+// Longest hibernation with WuRX listening, with or without a schedule. A
+// WuRX wake is timed by the 32 bit sys time, which wraps after ~71 min. With
+// WuRX off outside the windows the timer runs to the next window (unit of s)
+#define CFG_LUNCH_SCHED_MAX_HIB_S 3600
+
+/*
+ * WuRX Group
+ *******************************************************************************
+ */
+
+// Byte offset of wurx0_gid in the PMU_WURX nvds tag (0xB4). With gid_on in
+// the lunch data it is derived from the school ID (and group), and written
+// when the lunch data is written and the group ID changed
+#define CFG_WURX_GID_OFS 8
+// Group ID byte used until the tag is provisioned, matches what is flashed
+#define CFG_WURX_GID_DEFAULT 0xaa
+
+/*
+ * WuRX Tuning
+ *******************************************************************************
+ */
+
+// Byte offsets of the detection threshold and duty cycle in the PMU_WURX
+// nvds tag (0xB4, see tag_data/b4-PMU_WURX). Only bytes 0-11 (general, uid,
+// gid) are known here, so both are left out and the tag only counts real
+// and false wakes and logs the level it would pick. Define both from the
+// SDK's PMU_WURX layout for the board to have the level written back
+// #define CFG_WURX_TUNE_THRESH_OFS
+// #define CFG_WURX_TUNE_DUTY_OFS
+
+// Safe bounds, as steps away from the flashed values. Each level raises the
+// threshold until it is at its limit, then lowers the duty cycle
+#define CFG_WURX_TUNE_THRESH_STEP 1
+#define CFG_WURX_TUNE_THRESH_MAX_STEPS 4
+#define CFG_WURX_TUNE_DUTY_STEP 10
+#define CFG_WURX_TUNE_DUTY_MAX_STEPS 2
+
+// Look at the false wake rate every this many WuRX wakes, and go one level
+// less sensitive when more than this share of them were false
+#define CFG_WURX_TUNE_EVAL_WAKES 16
+#define CFG_WURX_TUNE_FALSE_PCT 50
+
+// A wake that timed out without the gate still counts as real if the gate
+// wakes us again within this long, warm or from hibernation (unit of s)
+#define CFG_WURX_TUNE_CONFIRM_S 900
+
+// Without a schedule, a tuned tag wakes on a timer this often and steps
+// back one level after CFG_WURX_TUNE_QUIET_S without a real wake (unit of
+// s). The timer must stay under the 71 min wrap of the sys time
+#define CFG_WURX_TUNE_TIMER_S 3600
+#define CFG_WURX_TUNE_QUIET_S 86400
+
+/*
+ * Lunch Adv Duration
+ *******************************************************************************
+ */
+
+// Keep this many recent WuRX wakes, each as the time from the wake to the
+// last time the gate was heard (awake or by waking us again)
+#define CFG_LUNCH_ADV_LEARN_LEN 16
+
+// The next lunch adv runs for this percentile of the kept wakes plus the
+// margin. Until enough wakes were seen it runs for the ceiling
+#define CFG_LUNCH_ADV_LEARN_PCT 90
+#define CFG_LUNCH_ADV_LEARN_MARGIN_S 10
+#define CFG_LUNCH_ADV_LEARN_MIN_WAKES 4
+
+// Defaults for the bounds kept in nvds (tag 0xD8), used until the tag has
+// been written. The ceiling is the fixed duration from before (unit of s)
+#define CFG_LUNCH_ADV_LEARN_FLOOR_S 30
+#define CFG_LUNCH_ADV_LEARN_CEIL_S (CFG_ADV0_START_DURATION / 100)
+
+/*
+ * Connection Guard
+ *******************************************************************************
+ */
+
+// Disconnect a central that hasn't read or written anything for this long
+// (unit of 10ms)
+#define CFG_LUNCH_CONN_IDLE_CS 3000 // 30s
+
+// Total connected time allowed per pairing session, over all connections.
+// Once used up, new connections are refused until the next button press
+// (unit of 10ms)
+#define CFG_LUNCH_CONN_SESSION_CS 18000 // 3 min
+
+// Provisioning stations in the accept list (nvds tag 0xD7). Without the tag
+// any central may connect
+#define CFG_LUNCH_CONN_ACCEPT_MAX 4
+
+/*
+ * OTA
+ *******************************************************************************
+ */
+
+// Flash the running image starts at, deltas copy from here. These are
+// placeholders, set them from the board's flash map before building with
+// OTA=1 (unit of bytes from the start of flash)
+#define CFG_LUNCH_OTA_RUN_ADDR 0x00000
+// Most of the running image a delta may be made against
+#define CFG_LUNCH_OTA_RUN_SIZE 0x40000
+// Staged image slot, must not overlap the running image or nvds
+#define CFG_LUNCH_OTA_SLOT_ADDR 0x40000
+#define CFG_LUNCH_OTA_SLOT_SIZE 0x30000
+#define CFG_LUNCH_OTA_SECTOR 4096
+
+// Most delta bytes in one data write, the host sends less for a smaller MTU
+#define CFG_LUNCH_OTA_CHUNK_MAX 508
+// Save the transfer to nvds after this many delta bytes
+#define CFG_LUNCH_OTA_CKPT_BYTES 4096
+// Bytes of flash CRCed per timer tick when checking the base or the image
+#define CFG_LUNCH_OTA_CHECK_BYTES 2048
+
+/*
+ * NVDS Cache
+ *******************************************************************************
+ */
+
+// Our own nvds tags are kept in RAM after the first lookup, missing ones
+// too, so repeated lookups and wakes from retention don't walk the nvds
+// area in flash. Puts write through. Tags that don't fit are read from
+// flash every time. 0 to always read flash (unit of bytes)
+#define CFG_LUNCH_NVDS_CACHE_LEN 192
+#define CFG_LUNCH_NVDS_CACHE_TAGS 10
+
+/*
+ * Tokenized Log
+ *******************************************************************************
+ */
+
+// Size of the RAM ring the log is kept in until it is drained (unit of 4 bytes)
+#define CFG_LUNCH_TLOG_WORDS 512
+
+/*
+ * Trace
+ *******************************************************************************
+ */
+
+// Number of trace records kept in RAM, oldest are overwritten (12 bytes each)
+#define CFG_LUNCH_TRACE_LEN 256
@@ -0,0 +1,184 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_adv_learn.c
+ *
+ * @brief Lunch adv duration learned from recent wakes
+ *
+ * For every WuRX wake we note how long after it the gate was last heard,
+ * either by a WuRX hit while advertising or by waking us again from
+ * retention. Wakes where the gate was never heard again tell us nothing and
+ * are left out. The next lunch adv runs for a percentile of the last
+ * CFG_LUNCH_ADV_LEARN_LEN wakes plus a margin, within the floor and ceiling
+ * from nvds. A student who walks straight to the register stops costing
+ * 300s of advertising, one who waits in a long line still gets counted.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "arch.h"
+#include "nvds.h"
+#include "timer.h"
+#include "atm_log.h"
+
+#include "cfg_adv_params.h"
+#include "cfg_lunch_params.h"
+#include "lunch_adv_learn.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_wake.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_adv_learn", V);
+
+// atm_adv_start_t duration is 16 bits of 10ms
+#define DUR_MAX_S (0xFFFF / 100)
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static nvds_adv_learn_t learn;
+static bool loaded;
+static bool wake_open;
+static bool heard;
+static uint32_t wake_time;
+static uint32_t heard_time;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+static void load(void)
+{
+    if (loaded) {
+        return;
+    }
+    loaded = true;
+
+    if (nvds_get_adv_learn(&learn) != NVDS_OK) {
+        memset(&learn, 0, sizeof(learn));
+    }
+
+    // Not provisioned, or provisioned with bounds we can't use
+    if (!learn.ceil_s || learn.floor_s > learn.ceil_s ||
+        !learn.pct || learn.pct > 100) {
+        learn.floor_s = CFG_LUNCH_ADV_LEARN_FLOOR_S;
+        learn.ceil_s = CFG_LUNCH_ADV_LEARN_CEIL_S;
+        learn.pct = CFG_LUNCH_ADV_LEARN_PCT;
+    }
+    if (learn.ceil_s > DUR_MAX_S) {
+        learn.ceil_s = DUR_MAX_S;
+    }
+    if (learn.count > CFG_LUNCH_ADV_LEARN_LEN || learn.head >= CFG_LUNCH_ADV_LEARN_LEN) {
+        learn.count = 0;
+        learn.head = 0;
+    }
+}
+
+// Nearest rank over the kept wakes
+static uint16_t percentile(void)
+{
+    uint16_t sorted[CFG_LUNCH_ADV_LEARN_LEN];
+    memcpy(sorted, learn.wake_s, learn.count * sizeof(uint16_t));
+
+    for (uint8_t i = 1; i < learn.count; i++) {
+        uint16_t v = sorted[i];
+        uint8_t j = i;
+        for (; j && sorted[j - 1] > v; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = v;
+    }
+
+    uint8_t rank = ((uint16_t) learn.count * learn.pct + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static void record(uint32_t since_wake_us)
+{
+    load();
+
+    uint32_t wake_s = since_wake_us / 1000000;
+    learn.wake_s[learn.head] = wake_s > 0xFFFF ? 0xFFFF : wake_s;
+    learn.head = (learn.head + 1) % CFG_LUNCH_ADV_LEARN_LEN;
+    if (learn.count < CFG_LUNCH_ADV_LEARN_LEN) {
+        learn.count++;
+    }
+
+    if (learn.count >= CFG_LUNCH_ADV_LEARN_MIN_WAKES) {
+        uint32_t dur_s = percentile() + CFG_LUNCH_ADV_LEARN_MARGIN_S;
+        dur_s = dur_s < learn.floor_s ? learn.floor_s : dur_s;
+        learn.dur_s = dur_s > learn.ceil_s ? learn.ceil_s : dur_s;
+    }
+
+    LUNCH_LOG(D, LL_ADV_LEARN_WAKE, "Gate heard %lus after wake, next adv %lus (%d wakes)",
+        wake_s, learn.dur_s, learn.count);
+    nvds_put_adv_learn(&learn);
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_adv_learn_wake(void)
+{
+    uint32_t now = atm_get_sys_time();
+
+    // Woken again from retention, the gate was still there until now
+    if (wake_open) {
+        record(now - wake_time);
+    }
+
+    wake_open = true;
+    heard = false;
+    wake_time = now;
+}
+
+void lunch_adv_learn_contact(void)
+{
+    if (!wake_open) {
+        return;
+    }
+
+    heard = true;
+    heard_time = atm_get_sys_time();
+}
+
+void lunch_adv_learn_sleep(void)
+{
+    if (!wake_open) {
+        return;
+    }
+    wake_open = false;
+
+    if (heard) {
+        record(heard_time - wake_time);
+    }
+}
+
+__WAKE_PATH uint16_t lunch_adv_learn_duration(void)
+{
+    // dur_s was clamped when it was learned, the bounds don't matter here
+    nvds_adv_learn_t rec;
+    nvds_adv_learn_t const *src = &learn;
+    if (!loaded) {
+        if (nvds_get_adv_learn(&rec) != NVDS_OK) {
+            return CFG_ADV0_START_DURATION;
+        }
+        src = &rec;
+    }
+
+    if (!src->dur_s || src->dur_s > DUR_MAX_S) {
+        return CFG_ADV0_START_DURATION;
+    }
+
+    LUNCH_LOG(D, LL_ADV_LEARN_DUR, "Lunch adv for %ds", src->dur_s);
+    return src->dur_s * 100;
+}
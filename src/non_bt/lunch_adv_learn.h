@@ -0,0 +1,76 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_adv_learn.h
+ *
+ * @brief Lunch adv duration learned from recent wakes
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include "arch.h"
+#include "cfg_adv_params.h"
+#include "cfg_lunch_params.h"
+
+/**
+ * @brief NVDS learned lunch adv duration record
+ * @note floor_s, ceil_s and pct can be provisioned per school, the rest is
+ * written by the tag
+ */
+typedef struct {
+    uint16_t floor_s;
+    uint16_t ceil_s;
+    uint8_t pct;
+    uint8_t count;
+    uint8_t head;
+    uint8_t rsvd;
+    uint16_t dur_s; // next lunch adv duration, 0 until learned
+    uint16_t wake_s[CFG_LUNCH_ADV_LEARN_LEN];
+} __PACKED nvds_adv_learn_t;
+
+#ifdef CFG_LUNCH_ADV_LEARN
+
+/**
+ *******************************************************************************
+ * @brief A WuRX wake started
+ * @note Call on a WuRX boot and on a WuRX wake from retention. A wake from
+ * retention closes the previous one, the gate was still there
+ *******************************************************************************
+ */
+void lunch_adv_learn_wake(void);
+
+/**
+ *******************************************************************************
+ * @brief The gate was heard while awake
+ *******************************************************************************
+ */
+void lunch_adv_learn_contact(void);
+
+/**
+ *******************************************************************************
+ * @brief Close the current wake and learn the next duration from it
+ * @note Call before hibernating
+ *******************************************************************************
+ */
+void lunch_adv_learn_sleep(void);
+
+/**
+ *******************************************************************************
+ * @brief Duration to start the lunch adv with (unit of 10ms)
+ *******************************************************************************
+ */
+uint16_t lunch_adv_learn_duration(void);
+
+#else
+
+static inline void lunch_adv_learn_wake(void) {}
+static inline void lunch_adv_learn_contact(void) {}
+static inline void lunch_adv_learn_sleep(void) {}
+static inline uint16_t lunch_adv_learn_duration(void) { return CFG_ADV0_START_DURATION; }
+
+#endif // CFG_LUNCH_ADV_LEARN
@@ -10,6 +10,7 @@
  *******************************************************************************
  */
 #include <inttypes.h>
+#include <stdbool.h>
 #include "atm_log.h"
 #include "atm_button.h"
 #include "atm_vkey.h"
@@ -23,65 +24,78 @@
 // My stuff
 #include "lunch_beacon.h"
 #include "lunch_button.h"
+#include "lunch_log.h"
+#include "lunch_trace.h"
 
 ATM_LOG_LOCAL_SETTING("lunch_button", V);
 
 // Button Configuration
 #define BTN_PRESS_MIN_TIME_CS 200
-#define BTN_CHECK_PRESS_INTERVAL_CS 20
-#define MAX_PRESS_CHECKS (BTN_PRESS_MIN_TIME_CS / BTN_CHECK_PRESS_INTERVAL_CS)
 #ifndef PIN_BUTTON1_IO
 #define PIN_BUTTON1_IO 10
 #endif
 
 static press_event_cb event_cb;
-static sw_timer_id_t check_press_tid;
+static sw_timer_id_t long_press_tid;
 static pm_lock_id_t lock_hiber;
+static bool pressed;
 
-int check_press_counter = 0;
+static void wait_for_press(void)
+{
+    pressed = false;
+    atm_gpio_int_set_rising(PIN_BUTTON1_IO);
+    atm_gpio_set_int_enable(PIN_BUTTON1_IO);
+    LUNCH_PM_UNLOCK(lock_hiber);
+}
 
-static void check_press(sw_timer_id_t timer_id, const void *ctx)
+static void wait_for_release(void)
 {
-    sw_timer_clear(check_press_tid);
+    pressed = true;
+    LUNCH_PM_LOCK(lock_hiber);
+    atm_gpio_int_set_falling(PIN_BUTTON1_IO);
+    atm_gpio_set_int_enable(PIN_BUTTON1_IO);
 
-    check_press_counter++;
+    // One timeout for the whole press instead of polling the pin
+    sw_timer_set(long_press_tid, BTN_PRESS_MIN_TIME_CS);
+}
 
-    if(check_press_counter >= MAX_PRESS_CHECKS) {
-        event_cb(); 
-        check_press_counter = 0;
+/*
+ * @brief Button held for BTN_PRESS_MIN_TIME_CS without a falling edge
+ */
+static void long_press(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(long_press_tid);
 
-        atm_pm_unlock(lock_hiber);
-    } else {
-        if(atm_gpio_read_gpio(PIN_BUTTON1_IO) == 1) {
-            // Still pressing, keep checking
-            sw_timer_set(check_press_tid, BTN_CHECK_PRESS_INTERVAL_CS);
-        } else {
-            // Stopped pressing, abort
-            check_press_counter = 0;
-            atm_pm_unlock(lock_hiber);
-        }
+    // Guard against a missed edge
+    if(pressed && atm_gpio_read_gpio(PIN_BUTTON1_IO) == 1) {
+        event_cb();
     }
+
+    wait_for_press();
 }
 
 __FAST static void interrupt_hdlr(uint32_t mask)
 {
-    ATM_LOG(V, "Button Press");
-    atm_pm_lock(lock_hiber);
-
     atm_gpio_set_int_disable(PIN_BUTTON1_IO);
     atm_gpio_clear_int_status(PIN_BUTTON1_IO);
 
-    atm_gpio_int_set_rising(PIN_BUTTON1_IO);
-    atm_gpio_set_int_enable(PIN_BUTTON1_IO);
-
-    sw_timer_set(check_press_tid, BTN_CHECK_PRESS_INTERVAL_CS);
+    if(!pressed) {
+        // Rising edge
+        LUNCH_LOG(V, LL_BUTTON_PRESS, "Button Press");
+        wait_for_release();
+    } else {
+        // Falling edge before the timeout, short press
+        LUNCH_LOG(V, LL_BUTTON_RELEASE, "Button Release");
+        sw_timer_clear(long_press_tid);
+        wait_for_press();
+    }
 }
 
 void lunch_button_init(press_event_cb cb)
 {
     // Register timer and callback
 	event_cb = cb;
-    check_press_tid = sw_timer_alloc(check_press, NULL);
+    long_press_tid = sw_timer_alloc(long_press, NULL);
 
     // Setup GPIO for button
     atm_gpio_setup(PIN_BUTTON1_IO);
@@ -89,16 +103,25 @@ void lunch_button_init(press_event_cb cb)
 
     interrupt_install_gpio(PIN_BUTTON1_IO, 3, interrupt_hdlr);    
 
-    atm_gpio_int_set_rising(PIN_BUTTON1_IO);
-    atm_gpio_set_int_enable(PIN_BUTTON1_IO);
-
     // Lock Hiber
     lock_hiber = atm_pm_alloc(PM_LOCK_HIBERNATE);
-    atm_pm_unlock(lock_hiber);
+    wait_for_press();
 }
 
-void lunch_button_on_wake(void) {
-    // We could be awaken by a press, so check here
-    sw_timer_set(check_press_tid, BTN_CHECK_PRESS_INTERVAL_CS);
+bool lunch_button_on_wake(void)
+{
+    // A WuRX wake leaves the pin low, nothing to wait for
+    if(atm_gpio_read_gpio(PIN_BUTTON1_IO) != 1) {
+        return false;
+    }
+
+    // Woken by a press, the rising edge happened before we booted
+    atm_gpio_set_int_disable(PIN_BUTTON1_IO);
+    wait_for_release();
+    return true;
 }
 
+bool lunch_button_held(void)
+{
+    return pressed;
+}
@@ -12,6 +12,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 
 typedef void (*press_event_cb)(void);
 
@@ -26,7 +27,17 @@ void lunch_button_init(press_event_cb cb);
 
 /**
  *******************************************************************************
- * @brief Check if we are still pressing button when device is awoken
+ * @brief Check if the button woke the device and is still held
+ * @note Only reads the pin, so a WuRX wake costs nothing here
+ * @returns true if a long press is being timed
  *******************************************************************************
  */
-void lunch_button_on_wake(void);
+bool lunch_button_on_wake(void);
+
+/**
+ *******************************************************************************
+ * @brief Check if a press is being timed
+ * @returns true between the rising edge and the release or long press
+ *******************************************************************************
+ */
+bool lunch_button_held(void);
@@ -0,0 +1,151 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_energy.c
+ *
+ * @brief Battery monitoring and per phase energy accounting
+ *
+ * Time in each phase is measured with the sys time and scaled by the current
+ * model in cfg_lunch_params.h. Hibernation is longer than the sys time wrap,
+ * so its time comes from the lunch clock instead. Counters are kept in nvds
+ * so they add up over the life of the battery, and saved only on wakes that
+ * did something. A schedule timer wake leaves them to the next one.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "arch.h"
+#include "nvds.h"
+#include "timer.h"
+#include "sadc.h"
+#include "atm_log.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_energy.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_wake.h"
+#include "lunch_sched.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_energy", V);
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static nvds_energy_t energy;
+static lunch_energy_phase_t cur_phase;
+static uint32_t phase_start;
+static uint32_t adv_intv_us;
+static bool timer_hop;
+
+static uint32_t const phase_ua[ENERGY_PHASE_NUM] = {
+    [ENERGY_BOOT] = CFG_ENERGY_BOOT_UA,
+    [ENERGY_GAP_INIT] = CFG_ENERGY_GAP_INIT_UA,
+    [ENERGY_ADV] = CFG_ENERGY_ADV_IDLE_UA,
+    [ENERGY_CONNECTED] = CFG_ENERGY_CONNECTED_UA,
+    [ENERGY_RETAIN] = CFG_ENERGY_RETAIN_UA,
+};
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH static uint16_t read_vbat_mv(void)
+{
+    return (uint16_t) sadc_read_vbatt();
+}
+
+__WAKE_PATH static void charge_phase(uint32_t now)
+{
+    uint32_t dur_us = now - phase_start;
+    phase_start = now;
+
+    energy.charge_uc[cur_phase] += (uint32_t)(((uint64_t) phase_ua[cur_phase] * dur_us) / 1000000);
+
+    if (cur_phase == ENERGY_ADV && adv_intv_us) {
+        uint32_t events = dur_us / adv_intv_us;
+        energy.adv_events += events;
+        energy.charge_uc[ENERGY_ADV] += (uint32_t)(((uint64_t) events * CFG_ENERGY_ADV_EVENT_NC) / 1000);
+    }
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH void lunch_energy_on_wake(void)
+{
+    uint32_t now = atm_get_sys_time();
+
+    if (nvds_get_energy(&energy) != NVDS_OK) {
+        memset(&energy, 0, sizeof(energy));
+    }
+
+    energy.vbat_mv = read_vbat_mv();
+    if (!energy.vbat_min_mv || energy.vbat_mv < energy.vbat_min_mv) {
+        energy.vbat_min_mv = energy.vbat_mv;
+    }
+    energy.wakes++;
+
+    cur_phase = ENERGY_BOOT;
+    phase_start = now;
+
+    LUNCH_LOG(D, LL_ENERGY_WAKE, "lunch_energy_on_wake: vbat=%dmV wakes=%lu", energy.vbat_mv, energy.wakes);
+}
+
+__WAKE_PATH void lunch_energy_phase(lunch_energy_phase_t phase)
+{
+    if (phase == cur_phase) {
+        return;
+    }
+
+    charge_phase(atm_get_sys_time());
+    cur_phase = phase;
+}
+
+void lunch_energy_set_adv_intv(uint32_t intv)
+{
+    adv_intv_us = intv * 625;
+}
+
+void lunch_energy_timer_hop(void)
+{
+    timer_hop = true;
+}
+
+void lunch_energy_on_sleep(void)
+{
+    // Nothing was loaded or charged on a timer wake, and it is not worth a
+    // flash write. The clock keeps the hibernation time until a real wake
+    if (timer_hop) {
+        return;
+    }
+
+    charge_phase(atm_get_sys_time());
+    cur_phase = ENERGY_HIB;
+
+    uint32_t hib_s = lunch_sched_take_hib_s();
+    energy.hib_s += hib_s;
+    energy.charge_uc[ENERGY_HIB] += (uint32_t)(((uint64_t) CFG_ENERGY_HIB_NA * hib_s) / 1000);
+
+    nvds_put_energy(&energy);
+}
+
+nvds_energy_t const *lunch_energy_get(void)
+{
+    return &energy;
+}
+
+uint8_t lunch_energy_vbat_byte(void)
+{
+    uint16_t step = energy.vbat_mv / CFG_ENERGY_VBAT_STEP_MV;
+    return step > 0xFF ? 0xFF : step;
+}
@@ -0,0 +1,97 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_energy.h
+ *
+ * @brief Battery monitoring and per phase energy accounting
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include <inttypes.h>
+#include "arch.h"
+
+typedef enum {
+    ENERGY_BOOT,
+    ENERGY_GAP_INIT,
+    ENERGY_ADV,
+    ENERGY_CONNECTED,
+    ENERGY_RETAIN,
+    ENERGY_HIB,
+    ENERGY_PHASE_NUM,
+} lunch_energy_phase_t;
+
+/**
+ * @brief NVDS Energy record
+ * @note Charge is in units of uC (uA * s). Also the value of the energy
+ * characteristic, so keep tools/battery_life.py in sync
+ */
+typedef struct {
+    uint32_t charge_uc[ENERGY_PHASE_NUM];
+    uint32_t adv_events;
+    uint32_t wakes;
+    uint32_t hib_s; // time spent hibernating (unit of s)
+    uint16_t vbat_mv;
+    uint16_t vbat_min_mv;
+} __PACKED nvds_energy_t;
+
+/**
+ *******************************************************************************
+ * @brief Sample the battery and load the counters
+ * @note Call once per wake, as early as possible
+ *******************************************************************************
+ */
+void lunch_energy_on_wake(void);
+
+/**
+ *******************************************************************************
+ * @brief Charge the time spent so far to the current phase and switch phase
+ *
+ * @param[in] phase  Phase we are entering
+ *******************************************************************************
+ */
+void lunch_energy_phase(lunch_energy_phase_t phase);
+
+/**
+ *******************************************************************************
+ * @brief Set the adv interval used to turn adv time into adv events
+ *
+ * @param[in] intv  Adv interval (unit of 0.625ms)
+ *******************************************************************************
+ */
+void lunch_energy_set_adv_intv(uint32_t intv);
+
+/**
+ *******************************************************************************
+ * @brief This wake was only the schedule timer, don't save the counters
+ * @note Call instead of lunch_energy_on_wake. The wake is not counted and
+ * its time awake is not charged
+ *******************************************************************************
+ */
+void lunch_energy_timer_hop(void);
+
+/**
+ *******************************************************************************
+ * @brief Close the current phase, charge the hibernation the lunch clock
+ * carried and save the counters to nvds
+ * @note Call right before hibernation
+ *******************************************************************************
+ */
+void lunch_energy_on_sleep(void);
+
+/**
+ *******************************************************************************
+ * @brief Get the current energy record
+ *******************************************************************************
+ */
+nvds_energy_t const *lunch_energy_get(void);
+
+/**
+ *******************************************************************************
+ * @brief Battery voltage in a single byte for the scan response
+ *******************************************************************************
+ */
+uint8_t lunch_energy_vbat_byte(void);
@@ -0,0 +1,142 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_fsm.c
+ *
+ * @brief App state machine dispatcher
+ *
+ * A move is one lookup in the [state][op] table, so it costs the same
+ * however many transitions lunch_fsm.def grows.
+ *
+ * Ops are run to completion. An op posted from a handler or callback while
+ * another one is running waits in a small queue, and the queue is drained
+ * in order before lunch_fsm_post returns to whoever started it. An op that
+ * is already waiting is not queued twice.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include "arch.h"
+#include "timer.h"
+#include "atm_log.h"
+
+#include "lunch_fsm.h"
+#include "lunch_log.h"
+#include "lunch_trace.h"
+#include "lunch_wake.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_fsm", V);
+
+#define FSM_QUEUE_LEN 4
+
+typedef struct {
+    uint8_t op;
+    uint32_t time; // sys time it was posted
+} fsm_post_t;
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static lunch_fsm_tbl_t const *fsm_tbl;
+static lunch_fsm_cb_t fsm_cb;
+static uint8_t cur_state;
+static uint8_t last_op = OP_END;
+static fsm_post_t queue[FSM_QUEUE_LEN];
+static uint8_t q_head;
+static uint8_t q_len;
+static bool running;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH static void dispatch(fsm_post_t const *post)
+{
+    uint32_t wait_us = atm_get_sys_time() - post->time;
+    LUNCH_TRACE(TR_OP_WAIT, post->op, wait_us > UINT16_MAX ? UINT16_MAX : wait_us);
+
+    uint8_t op = post->op;
+    uint8_t last_s = cur_state;
+    if (op >= OP_NUM || !(*fsm_tbl)[last_s][op].valid) {
+        LUNCH_LOG(W, LL_FSM_NO_TRANS, "No transition from state %d on op %d", last_s, op);
+        return;
+    }
+
+    lunch_fsm_entry_t const *entry = &(*fsm_tbl)[last_s][op];
+    cur_state = entry->next;
+    last_op = op;
+
+    if (fsm_cb) {
+        fsm_cb(last_s, op, entry->next);
+    }
+    if (entry->handler) {
+        entry->handler();
+    }
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH void lunch_fsm_init(lunch_fsm_tbl_t const *tbl, lunch_fsm_cb_t cb)
+{
+    fsm_tbl = tbl;
+    fsm_cb = cb;
+    cur_state = S_INIT;
+    last_op = OP_END;
+    q_len = 0;
+}
+
+__WAKE_PATH void lunch_fsm_post(APP_OP op)
+{
+    for (uint8_t i = 0; i < q_len; i++) {
+        if (queue[(q_head + i) % FSM_QUEUE_LEN].op == op) {
+            LUNCH_LOG(V, LL_FSM_MERGE, "Op %d already queued", op);
+            return;
+        }
+    }
+
+    if (q_len == FSM_QUEUE_LEN) {
+        LUNCH_LOG(E, LL_FSM_QUEUE_FULL, "Op queue full, dropped op %d", op);
+        return;
+    }
+
+    queue[(q_head + q_len) % FSM_QUEUE_LEN] = (fsm_post_t) {op, atm_get_sys_time()};
+    q_len++;
+
+    // Posted from inside a transition, the outer call runs it
+    if (running) {
+        return;
+    }
+
+    running = true;
+    while (q_len) {
+        fsm_post_t post = queue[q_head];
+        q_head = (q_head + 1) % FSM_QUEUE_LEN;
+        q_len--;
+        dispatch(&post);
+    }
+    running = false;
+}
+
+APP_STATE lunch_fsm_state(void)
+{
+    return cur_state;
+}
+
+APP_OP lunch_fsm_last_op(void)
+{
+    return last_op;
+}
+
+void lunch_fsm_set(APP_STATE state, APP_OP op)
+{
+    cur_state = state;
+    last_op = op;
+}
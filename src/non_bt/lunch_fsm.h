@@ -0,0 +1,76 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_fsm.h
+ *
+ * @brief App state machine dispatcher
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "lunch_beacon.h"
+
+typedef void (*lunch_fsm_handler_t)(void);
+typedef void (*lunch_fsm_cb_t)(uint8_t last_s, uint8_t op, uint8_t next_s);
+
+typedef struct {
+    lunch_fsm_handler_t handler;
+    uint8_t next;
+    bool valid;
+} lunch_fsm_entry_t;
+
+/**
+ * @brief Transition table indexed by [state][op]
+ * @note Build it from lunch_fsm.def with LUNCH_FSM_ENTRY
+ */
+typedef lunch_fsm_entry_t lunch_fsm_tbl_t[S_NUM][OP_NUM];
+
+#define LUNCH_FSM_ENTRY(state, op, next, handler) \
+    [state][op] = {handler, next, true},
+
+/**
+ *******************************************************************************
+ * @brief Start the state machine in S_INIT
+ *
+ * @param[in] tbl  Transition table
+ * @param[in] cb   Called on every transition, before the handler
+ *******************************************************************************
+ */
+void lunch_fsm_init(lunch_fsm_tbl_t const *tbl, lunch_fsm_cb_t cb);
+
+/**
+ *******************************************************************************
+ * @brief Post an op, then run queued ops until the queue is empty
+ * @note From inside a handler or transition callback the op only waits its
+ * turn, it runs once the current handler returns. An op with no transition
+ * from the state it runs in is logged and dropped
+ *******************************************************************************
+ */
+void lunch_fsm_post(APP_OP op);
+
+/**
+ *******************************************************************************
+ * @brief Current state
+ *******************************************************************************
+ */
+APP_STATE lunch_fsm_state(void);
+
+/**
+ *******************************************************************************
+ * @brief Op of the last transition, OP_END after lunch_fsm_set
+ *******************************************************************************
+ */
+APP_OP lunch_fsm_last_op(void);
+
+/**
+ *******************************************************************************
+ * @brief Force the state from a handler
+ * @note Pass OP_END unless the op matters to a later lunch_fsm_last_op
+ *******************************************************************************
+ */
+void lunch_fsm_set(APP_STATE state, APP_OP op);
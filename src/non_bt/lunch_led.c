@@ -13,6 +13,7 @@
 #include "arch.h"
 #include <inttypes.h>
 #include "led_blink.h"
+#include "timer.h"
 #include "lunch_led.h"
 
 typedef struct {
@@ -27,7 +28,14 @@ static lunch_led_blink_profile_t lunch_led_profiles[3] = {
     { .hi_dur = 10, .low_dur = 10, .times = 3, }, // PAIRING
 };
 
+// Sys time the current blink pattern is over
+static uint32_t blink_until;
+
 void lunch_led_blink(LUNCH_LED_STATE state) {
+    uint32_t dur_cs = (lunch_led_profiles[state].hi_dur + lunch_led_profiles[state].low_dur) *
+        lunch_led_profiles[state].times;
+    blink_until = atm_get_sys_time() + dur_cs * 10000;
+
     led_blink(LED_0, 
         lunch_led_profiles[state].hi_dur,
         lunch_led_profiles[state].low_dur,
@@ -35,5 +43,10 @@ void lunch_led_blink(LUNCH_LED_STATE state) {
 }
 
 void lunch_led_off(void) {
+    blink_until = atm_get_sys_time();
     led_off(LED_0);
+}
+
+bool lunch_led_busy(void) {
+    return (int32_t)(blink_until - atm_get_sys_time()) > 0;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
  *******************************************************************************
  */
 
+#include <stdbool.h>
+
 typedef enum {
     LUNCH_LED_OFF,
     LUNCH_LED_ACTIVE,
@@ -28,3 +30,9 @@ void lunch_led_blink(LUNCH_LED_STATE state);
  * 
  */
 void lunch_led_off(void);
+
+/**
+ * @brief Blink pattern still running
+ * 
+ */
+bool lunch_led_busy(void);
\ No newline at end of file
@@ -0,0 +1,100 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_log.c
+ *
+ * @brief Tokenized binary logging
+ *
+ * Each record is a timestamp word, an ID word and the argument words. Records
+ * are printed as "#T <ts> <id|nargs> <args>" hex lines for tools/tlog_decode.py
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#ifdef CFG_LUNCH_TLOG
+
+#include <stdio.h>
+#include "arch.h"
+#include "timer.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_log.h"
+
+#define RECORD_HDR_WORDS 2
+
+static uint32_t ring[CFG_LUNCH_TLOG_WORDS];
+static uint16_t head;
+static uint16_t tail;
+static uint16_t used;
+static uint16_t dropped;
+
+static void ring_push(uint32_t word)
+{
+    ring[head] = word;
+    head = (head + 1) % CFG_LUNCH_TLOG_WORDS;
+    used++;
+}
+
+static uint32_t ring_pop(void)
+{
+    uint32_t word = ring[tail];
+    tail = (tail + 1) % CFG_LUNCH_TLOG_WORDS;
+    used--;
+    return word;
+}
+
+__FAST void lunch_log_put(lunch_log_id_t id, uint32_t const *args, uint8_t nargs)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (used + RECORD_HDR_WORDS + nargs > CFG_LUNCH_TLOG_WORDS) {
+        dropped++;
+    } else {
+        ring_push(atm_get_sys_time());
+        ring_push((uint32_t) id | ((uint32_t) nargs << 8));
+        for (uint8_t i = 0; i < nargs; i++) {
+            ring_push(args[i]);
+        }
+    }
+
+    __set_PRIMASK(primask);
+}
+
+void lunch_log_drain(void)
+{
+    while (used) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        uint32_t ts = ring_pop();
+        uint32_t hdr = ring_pop();
+        uint8_t nargs = (hdr >> 8) & 0xFF;
+        uint32_t args[nargs ? nargs : 1];
+        for (uint8_t i = 0; i < nargs; i++) {
+            args[i] = ring_pop();
+        }
+
+        __set_PRIMASK(primask);
+
+        printf("#T %08lx %04lx", ts, hdr);
+        for (uint8_t i = 0; i < nargs; i++) {
+            printf(" %lx", args[i]);
+        }
+        printf("\n");
+    }
+
+    if (dropped) {
+        printf("#T dropped %u\n", dropped);
+        dropped = 0;
+    }
+}
+
+bool lunch_log_pending(void)
+{
+    return used != 0;
+}
+
+#endif // CFG_LUNCH_TLOG
@@ -0,0 +1,69 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_log.h
+ *
+ * @brief Tokenized binary logging
+ *
+ * LUNCH_LOG is a drop in for ATM_LOG on the wake path. With CFG_LUNCH_TLOG
+ * the format string never makes it into the image, only the message ID and
+ * the raw arguments are put in a RAM ring. The ring is printed once the radio
+ * work is done and tools/tlog_decode.py turns it back into text.
+ *
+ * Format strings can only use integer conversions (%d %u %x), no %s and no
+ * PRIx32 style macros, since the host decoder formats them with Python.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "atm_log.h"
+#include "lunch_log_ids.h"
+
+#ifdef CFG_LUNCH_TLOG
+
+#define LUNCH_LOG_ARGS(...) ((uint32_t const []){0, ##__VA_ARGS__})
+#define LUNCH_LOG(lvl, id, fmt, ...) \
+    lunch_log_put(id, LUNCH_LOG_ARGS(__VA_ARGS__) + 1, \
+        sizeof(LUNCH_LOG_ARGS(__VA_ARGS__)) / sizeof(uint32_t) - 1)
+
+/**
+ *******************************************************************************
+ * @brief Put a message in the log ring
+ * @note Safe to call from interrupts
+ *
+ * @param[in] id     Message ID
+ * @param[in] args   Arguments, each widened to 32 bits
+ * @param[in] nargs  Number of arguments
+ *******************************************************************************
+ */
+void lunch_log_put(lunch_log_id_t id, uint32_t const *args, uint8_t nargs);
+
+/**
+ *******************************************************************************
+ * @brief Print everything in the log ring to the debug UART
+ * @note Call when the radio work is done, not on the way to the first packet
+ *******************************************************************************
+ */
+void lunch_log_drain(void);
+
+/**
+ *******************************************************************************
+ * @brief Records are waiting in the ring
+ *******************************************************************************
+ */
+bool lunch_log_pending(void);
+
+#else
+
+#define LUNCH_LOG(lvl, id, fmt, ...) ATM_LOG(lvl, fmt, ##__VA_ARGS__)
+
+static inline void lunch_log_drain(void) {}
+static inline bool lunch_log_pending(void) { return false; }
+
+#endif
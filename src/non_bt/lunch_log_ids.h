@@ -0,0 +1,93 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_log_ids.h
+ *
+ * @brief Tokenized log message IDs
+ *
+ * One ID per LUNCH_LOG call site. tools/tlog_decode.py reads this list and
+ * the format strings at the call sites, so only append to keep old captures
+ * decodable.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+typedef enum {
+    LL_USER_MAIN_DONE,
+    LL_WURX_BOOT,
+    LL_COLD_BOOT,
+    LL_ASM_STATE,
+    LL_S_INIT,
+    LL_GAP_INIT_CFM,
+    LL_GAP_CONN_IND,
+    LL_GAP_DISC_IND,
+    LL_S_CREATE_LUNCH_ADV,
+    LL_S_CREATE_PAIR_ADV,
+    LL_S_DELETE_PAIR_ADV, // retired
+    LL_S_STOP_ADV_AND_PAIR, // retired
+    LL_S_START_ON,
+    LL_S_CONNECTED,
+    LL_S_DISCONNECTED,
+    LL_S_TIMEOUT,
+    LL_S_WARM,
+    LL_ADV_START_DELAY,
+    LL_ADV_STATE,
+    LL_ADV_CREATED,
+    LL_ADV_CREATE_CFM,
+    LL_LUNCH_DATA_NOT_SET,
+    LL_LUNCH_TOKEN,
+    LL_NEW_ADV_DATA,
+    LL_LUNCH_PERIOD_OVER,
+    LL_WURX_WARM_WAKE,
+    LL_WURX_ENABLE,
+    LL_WURX_EVENT,
+    LL_ENTER_HIB,
+    LL_BUTTON_PRESS,
+    LL_CA_SEED,
+    LL_CA_APPLY,
+    LL_ENERGY_WAKE,
+    LL_BUTTON_RELEASE,
+    LL_BUTTON_WAKE,
+    LL_PAIR_ADV_BUSY,
+    LL_PAIR_ADV_ALREADY_ON,
+    LL_SCHED_WAKE,
+    LL_SCHED_RESYNC,
+    LL_SCHED_SLEEP,
+    LL_SCHED_SYNC,
+    LL_SCHED_TIMER_WAKE,
+    LL_WURX_TUNE_LEVEL,
+    LL_WURX_TUNE_CONTACT,
+    LL_WURX_TUNE_SLEEP,
+    LL_WURX_TUNE_MISS,
+    LL_WURX_AWAKE_HIT,
+    LL_SLEEP_TAIL,
+    LL_FSM_NO_TRANS,
+    LL_FSM_MERGE,
+    LL_FSM_QUEUE_FULL,
+    LL_CONN_REJECT,
+    LL_CONN_IDLE,
+    LL_CONN_SESSION_OVER,
+    LL_ADV_LEARN_WAKE,
+    LL_ADV_LEARN_DUR,
+    LL_PAIR_NOT_BUILT,
+    LL_OTA_START,
+    LL_OTA_RESUME,
+    LL_OTA_BAD_BASE,
+    LL_OTA_FAIL,
+    LL_OTA_VERIFIED,
+    LL_OTA_INSTALL,
+    LL_OTA_NO_BOOTLOADER,
+    LL_PAIR_ADV_SLOW,   // no call site, the pairing burst is gone
+    LL_PAIR_INTV_FIXED, // no call site, the pairing burst is gone
+    LL_OTA_NO_KEY,
+    LL_OTA_NOT_LISTED,
+    LL_WURX_TUNE_ADVISE,
+    LL_WURX_TUNE_QUIET,
+    LL_SCHED_LOST,
+    LL_OTA_BAD_START,
+    LL_ID_NUM
+} lunch_log_id_t;
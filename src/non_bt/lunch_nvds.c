@@ -14,22 +14,186 @@
 #include "nvds.h"
 #include "nvds_tag.h"
 #include <inttypes.h>
+#include <string.h>
 #include "atm_log.h"
 #include "co_utils.h"
+#include "lunch_trace.h"
+#include "lunch_wake.h"
+#include "cfg_lunch_params.h"
 
 ATM_LOG_LOCAL_SETTING("lunch_nvds", V);
 
+#if CFG_LUNCH_NVDS_CACHE_LEN
+/**
+ * @brief NVDS cache entry
+ * @note A missing tag is cached with its error and no data. Room in the
+ * buffer is handed out once and never moves, an entry keeps it for good
+ */
+typedef struct {
+    uint8_t tag;
+    uint8_t err;
+    nvds_tag_len_t len;
+    nvds_tag_len_t cap;
+    uint16_t ofs;
+} nvds_cache_ent_t;
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+// Plain RAM, kept through retention and rebuilt after hibernation
+static nvds_cache_ent_t cache_ent[CFG_LUNCH_NVDS_CACHE_TAGS];
+static uint8_t cache_buf[CFG_LUNCH_NVDS_CACHE_LEN];
+static uint8_t cache_n;
+static uint16_t cache_used;
+#endif
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+#if CFG_LUNCH_NVDS_CACHE_LEN
+__WAKE_PATH static nvds_cache_ent_t *cache_find(uint8_t tag)
+{
+    for(uint8_t i = 0; i < cache_n; i++) {
+        if(cache_ent[i].tag == tag) return &cache_ent[i];
+    }
+    return NULL;
+}
+
+// Remember what nvds said about a tag, if there is room for it. A missing
+// tag gets room for the caller's buffer, so a later put of it fits
+__WAKE_PATH static void cache_store(uint8_t tag, uint8_t err, nvds_tag_len_t len, nvds_tag_len_t room,
+    uint8_t const *data)
+{
+    if(err == NVDS_OK && room < len) room = len;
+
+    nvds_cache_ent_t *ent = cache_find(tag);
+    if(!ent) {
+        if(cache_n == CFG_LUNCH_NVDS_CACHE_TAGS || cache_used + room > sizeof(cache_buf)) return;
+        ent = &cache_ent[cache_n++];
+        ent->tag = tag;
+        ent->cap = room;
+        ent->ofs = cache_used;
+        cache_used += room;
+    } else if(err == NVDS_OK && len > ent->cap) {
+        // Only the newest entry can grow, the rest go back to flash
+        if(ent != &cache_ent[cache_n - 1] || ent->ofs + len > sizeof(cache_buf)) {
+            ent->err = NVDS_FAIL;
+            return;
+        }
+        ent->cap = len;
+        cache_used = ent->ofs + len;
+    }
+
+    ent->err = err;
+    ent->len = err == NVDS_OK ? len : 0;
+    if(ent->len) memcpy(cache_buf + ent->ofs, data, len);
+}
+#endif
+
+// Every access goes through here so it shows up in the trace
+__WAKE_PATH static uint8_t lunch_nvds_get(uint8_t tag, nvds_tag_len_t *len, uint8_t *out)
+{
+#if CFG_LUNCH_NVDS_CACHE_LEN
+    // A cached value the caller has room for, or a tag we know is missing
+    nvds_cache_ent_t const *ent = cache_find(tag);
+    if(ent && ent->err == NVDS_TAG_NOT_DEFINED) {
+        LUNCH_TRACE(TR_NVDS_HIT, tag, ent->err);
+        return ent->err;
+    }
+    if(ent && ent->err == NVDS_OK && ent->len <= *len) {
+        memcpy(out, cache_buf + ent->ofs, ent->len);
+        *len = ent->len;
+        LUNCH_TRACE(TR_NVDS_HIT, tag, NVDS_OK);
+        return NVDS_OK;
+    }
+#endif
+
+#if CFG_LUNCH_NVDS_CACHE_LEN
+    nvds_tag_len_t room = *len;
+#endif
+    uint8_t err = nvds_get(tag, len, out);
+    LUNCH_TRACE(TR_NVDS_GET, tag, err);
+
+#if CFG_LUNCH_NVDS_CACHE_LEN
+    // Other errors may depend on the caller's buffer, those aren't kept
+    if(err == NVDS_OK || err == NVDS_TAG_NOT_DEFINED) cache_store(tag, err, *len, room, out);
+#endif
+    return err;
+}
+
+__WAKE_PATH static uint8_t lunch_nvds_put(uint8_t tag, nvds_tag_len_t len, uint8_t *data)
+{
+    uint8_t err = nvds_put(tag, len, data);
+    LUNCH_TRACE(TR_NVDS_PUT, tag, err);
+
+#if CFG_LUNCH_NVDS_CACHE_LEN
+    // Write through, a failed put leaves flash in doubt so the next get reads it
+    if(err == NVDS_OK) {
+        cache_store(tag, NVDS_OK, len, len, data);
+    } else {
+        nvds_cache_ent_t *ent = cache_find(tag);
+        if(ent) ent->err = NVDS_FAIL;
+    }
+#endif
+    return err;
+}
+
+#ifdef CFG_WURX
+/*
+ * @brief Derive the WuRX group ID from the school ID and group and write it
+ * into PMU_WURX if it changed
+ * @note FNV-1a, keep program/lunch_gid.py in sync. Unprovisioned tags, and
+ * tags without gid_on, keep the default group ID so any gate still wakes them
+ */
+static void put_wurx_gid(nvds_lunch_data_t const *data)
+{
+    uint8_t gid[WURX_GID_LEN];
+    if(!data->gid_on || data->school_id[0] == 0) {
+        memset(gid, CFG_WURX_GID_DEFAULT, WURX_GID_LEN);
+    } else {
+        uint32_t h = 0x811c9dc5;
+        for(uint8_t i = 0; i < SCHOOL_ID_ARR_LEN - 1 && data->school_id[i]; i++) {
+            h = (h ^ data->school_id[i]) * 0x01000193;
+        }
+        if(data->group) {
+            h = (h ^ data->group) * 0x01000193;
+        }
+        memcpy(gid, &h, WURX_GID_LEN);
+    }
+
+    uint8_t pmu[PMU_WURX_MAX_LEN];
+    nvds_tag_len_t len = sizeof(pmu);
+    if(nvds_get_pmu_wurx(pmu, &len) != NVDS_OK || len < CFG_WURX_GID_OFS + WURX_GID_LEN ||
+        !memcmp(pmu + CFG_WURX_GID_OFS, gid, WURX_GID_LEN)) {
+        return;
+    }
+
+    memcpy(pmu + CFG_WURX_GID_OFS, gid, WURX_GID_LEN);
+    nvds_put_pmu_wurx(pmu, len);
+    ATM_LOG(D, "WuRX gid %02x %02x %02x %02x", gid[0], gid[1], gid[2], gid[3]);
+}
+#endif
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
 uint8_t nvds_get_ble_addr(uint8_t *out, nvds_tag_len_t* len) {
-    uint8_t err = nvds_get(NVDS_TAG_BLE_ADDR, len, (uint8_t *) out);
+    uint8_t err = lunch_nvds_get(NVDS_TAG_BLE_ADDR, len, (uint8_t *) out);
     if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
 
     return err;
 }
 
-uint8_t nvds_get_lunch_data(nvds_lunch_data_t *out)
+__WAKE_PATH uint8_t nvds_get_lunch_data(nvds_lunch_data_t *out)
 {
     nvds_tag_len_t len = sizeof(nvds_lunch_data_t);
-    uint8_t err = nvds_get(NVDS_TAG_LUNCH_DATA, &len, (uint8_t *) out);
+    uint8_t err = lunch_nvds_get(NVDS_TAG_LUNCH_DATA, &len, (uint8_t *) out);
     if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
 
     return err;
@@ -38,9 +202,14 @@ uint8_t nvds_get_lunch_data(nvds_lunch_data_t *out)
 uint8_t nvds_put_lunch_data(nvds_lunch_data_t *data)
 {
     nvds_tag_len_t len = sizeof(nvds_lunch_data_t);
-    uint8_t err = nvds_put(NVDS_TAG_LUNCH_DATA, len, (uint8_t *) data);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_LUNCH_DATA, len, (uint8_t *) data);
     if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
 
+#ifdef CFG_WURX
+    // Only wake for gates aimed at our school (and group) from the next boot on
+    if(err == NVDS_OK) put_wurx_gid(data);
+#endif
+
     nvds_print_lunch_data();
 
     return err;
@@ -74,6 +243,177 @@ uint8_t nvds_put_student_data(uint8_t const *student_data)
     return nvds_put_lunch_data(&data);
 }
 
+uint8_t nvds_put_group_data(uint8_t const *group_data, uint16_t len)
+{
+    // Get current lunch data
+    nvds_lunch_data_t data = {0};
+    nvds_get_lunch_data(&data);
+
+    // Modify group, and the group ID switch if given
+    data.group = group_data[0];
+    if(len > 1) data.gid_on = group_data[1] != 0;
+
+    // Write back to nvds
+    return nvds_put_lunch_data(&data);
+}
+
+__WAKE_PATH uint8_t nvds_get_lunch_token(uint32_t n, uint8_t *out)
+{
+    uint8_t hdr[2];
+    nvds_tag_len_t len = sizeof(hdr);
+    uint8_t err = lunch_nvds_get(NVDS_TAG_LUNCH_TOKENS, &len, hdr);
+    if(err == NVDS_OK && (!hdr[1] || hdr[1] > LUNCH_TOKEN_BATCH_LEN)) err = NVDS_FAIL;
+    if(err != NVDS_OK) {
+        ATM_LOG(E, "%s - err = %d", __func__, err);
+        return err;
+    }
+
+    len = LUNCH_TOKEN_LEN;
+    err = lunch_nvds_get(NVDS_TAG_LUNCH_TOKEN_0 + n % hdr[1], &len, out);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_put_lunch_tokens(nvds_lunch_tokens_t const *data)
+{
+    // Tokens first, a batch cut short keeps the old count
+    for(uint8_t i = 0; i < data->count; i++) {
+        uint8_t err = lunch_nvds_put(NVDS_TAG_LUNCH_TOKEN_0 + i, LUNCH_TOKEN_LEN, (uint8_t *) data->token[i]);
+        if(err != NVDS_OK) {
+            ATM_LOG(E, "%s - err = %d", __func__, err);
+            return err;
+        }
+    }
+
+    uint8_t err = lunch_nvds_put(NVDS_TAG_LUNCH_TOKENS, 2, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    ATM_LOG(D, "Lunch tokens batch %d (%d tokens)", data->batch, data->count);
+
+    return err;
+}
+
+__WAKE_PATH uint8_t nvds_get_energy(nvds_energy_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_energy_t);
+    return lunch_nvds_get(NVDS_TAG_ENERGY, &len, (uint8_t *) out);
+}
+
+uint8_t nvds_put_energy(nvds_energy_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_energy_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_ENERGY, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+__WAKE_PATH uint8_t nvds_get_lunch_sched(nvds_lunch_sched_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_lunch_sched_t);
+    return lunch_nvds_get(NVDS_TAG_LUNCH_SCHED, &len, (uint8_t *) out);
+}
+
+uint8_t nvds_put_lunch_sched(nvds_lunch_sched_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_lunch_sched_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_LUNCH_SCHED, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    ATM_LOG(D, "Lunch schedule (%d windows)", data->count);
+
+    return err;
+}
+
+__WAKE_PATH uint8_t nvds_get_lunch_clock(nvds_lunch_clock_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_lunch_clock_t);
+    return lunch_nvds_get(NVDS_TAG_LUNCH_CLOCK, &len, (uint8_t *) out);
+}
+
+__WAKE_PATH uint8_t nvds_put_lunch_clock(nvds_lunch_clock_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_lunch_clock_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_LUNCH_CLOCK, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_get_pmu_wurx(uint8_t *out, nvds_tag_len_t *len)
+{
+    uint8_t err = lunch_nvds_get(NVDS_TAG_PMU_WURX, len, out);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_put_pmu_wurx(uint8_t *data, nvds_tag_len_t len)
+{
+    uint8_t err = lunch_nvds_put(NVDS_TAG_PMU_WURX, len, data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_get_wurx_tune(nvds_wurx_tune_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_wurx_tune_t);
+    return lunch_nvds_get(NVDS_TAG_WURX_TUNE, &len, (uint8_t *) out);
+}
+
+uint8_t nvds_put_wurx_tune(nvds_wurx_tune_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_wurx_tune_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_WURX_TUNE, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_get_conn_accept(uint8_t *out, nvds_tag_len_t *len)
+{
+    return lunch_nvds_get(NVDS_TAG_CONN_ACCEPT, len, out);
+}
+
+__WAKE_PATH uint8_t nvds_get_adv_learn(nvds_adv_learn_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_adv_learn_t);
+    return lunch_nvds_get(NVDS_TAG_ADV_LEARN, &len, (uint8_t *) out);
+}
+
+uint8_t nvds_put_adv_learn(nvds_adv_learn_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_adv_learn_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_ADV_LEARN, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_get_ota(nvds_ota_t *out)
+{
+    nvds_tag_len_t len = sizeof(nvds_ota_t);
+    return lunch_nvds_get(NVDS_TAG_OTA, &len, (uint8_t *) out);
+}
+
+uint8_t nvds_put_ota(nvds_ota_t const *data)
+{
+    nvds_tag_len_t len = sizeof(nvds_ota_t);
+    uint8_t err = lunch_nvds_put(NVDS_TAG_OTA, len, (uint8_t *) data);
+    if(err != NVDS_OK) ATM_LOG(E, "%s - err = %d", __func__, err);
+
+    return err;
+}
+
+uint8_t nvds_get_ota_key(uint8_t *out)
+{
+    nvds_tag_len_t len = LUNCH_OTA_KEY_LEN;
+    uint8_t err = lunch_nvds_get(NVDS_TAG_OTA_KEY, &len, out);
+    return err == NVDS_OK && len != LUNCH_OTA_KEY_LEN ? NVDS_LENGTH_OUT_OF_RANGE : err;
+}
+
 void nvds_print_lunch_data(void)
 {
     nvds_lunch_data_t data = {0};
@@ -82,5 +422,6 @@ void nvds_print_lunch_data(void)
     ATM_LOG(D, "=============================");
     ATM_LOG(D, "| School Data %s", data.school_id);
     ATM_LOG(D, "| Student Data %s", data.student_id);
+    ATM_LOG(D, "| Group %d, WuRX gid %s", data.group, data.gid_on ? "on" : "off");
     ATM_LOG(D, "==============================");
 }
@@ -13,9 +13,30 @@
 #include <inttypes.h>
 #include "arch.h"
 #include "nvds.h"
+#include "lunch_energy.h"
+#include "lunch_sched.h"
+#include "lunch_wurx_tune.h"
+#include "lunch_adv_learn.h"
+#include "lunch_ota.h"
 
 #define NVDS_TAG_BLE_ADDR 0x01
+#define NVDS_TAG_PMU_WURX 0xB4
 #define NVDS_TAG_LUNCH_DATA 0xD0
+#define NVDS_TAG_LUNCH_TOKENS 0xD1
+// 0xD2 was the wake count, the energy record counts wakes now
+#define NVDS_TAG_ENERGY 0xD3
+#define NVDS_TAG_LUNCH_SCHED 0xD4
+#define NVDS_TAG_LUNCH_CLOCK 0xD5
+#define NVDS_TAG_WURX_TUNE 0xD6
+#define NVDS_TAG_CONN_ACCEPT 0xD7
+#define NVDS_TAG_ADV_LEARN 0xD8
+#define NVDS_TAG_OTA 0xD9
+#define NVDS_TAG_OTA_KEY 0xDA
+#define NVDS_TAG_LUNCH_TOKEN_0 0xE0 // 0xE0-0xEF, one per token
+
+// Raw PMU_WURX block, see tag_data/b4-PMU_WURX
+#define PMU_WURX_MAX_LEN 32
+#define WURX_GID_LEN 4
 
 #define SCHOOL_ID_ARR_LEN 6
 #define STUDENT_ID_ARR_LEN 10
@@ -23,12 +44,38 @@
 /**
  * @brief NVDS Lunch Data type
  * @note The last byte for each array will always be 0 so that we can treat it like a string
+ * group is an optional grade or lunch period, 0 for the whole school. It is
+ * only used for the WuRX group ID and is not advertised. The derived group
+ * ID is only put in PMU_WURX once gid_on is set, records from before it read
+ * as off and keep the default one
  */
 typedef struct {
     uint8_t school_id[SCHOOL_ID_ARR_LEN];
     uint8_t student_id[STUDENT_ID_ARR_LEN];
+    uint8_t group;
+    uint8_t gid_on;
 } __PACKED nvds_lunch_data_t;
 
+// School and student ID, the part of the lunch data that goes in the lunch adv
+#define LUNCH_IDS_LEN (SCHOOL_ID_ARR_LEN + STUDENT_ID_ARR_LEN)
+
+// A token takes the place of the school and student ID in the lunch adv
+#define LUNCH_TOKEN_LEN LUNCH_IDS_LEN
+#define LUNCH_TOKEN_BATCH_LEN 16
+
+/**
+ * @brief Lunch Token table
+ * @note Precomputed by the provisioning station and written during pairing,
+ * so the wake path only has to pick the next one. This is the value of the
+ * tokens characteristic. In nvds batch and count are tag 0xD1 and every
+ * token has its own tag, so a wake reads only the token it sends
+ */
+typedef struct {
+    uint8_t batch;
+    uint8_t count;
+    uint8_t token[LUNCH_TOKEN_BATCH_LEN][LUNCH_TOKEN_LEN];
+} __PACKED nvds_lunch_tokens_t;
+
 /**
  * @brief Get lunch data from nvds tag
  * @returns NVDS_OK on success
@@ -59,6 +106,124 @@ uint8_t nvds_put_school_data(uint8_t const *school_data);
 */
 uint8_t nvds_put_student_data(uint8_t const *student_data);
 
+/**
+ * @brief Modify only the grade or lunch period, and gid_on if len is 2, and
+ * put into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_group_data(uint8_t const *group_data, uint16_t len);
+
+/**
+ * @brief Get one lunch token from nvds
+ * @param[in] n  Wake count, wrapped around the batch
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_lunch_token(uint32_t n, uint8_t *out);
+
+/**
+ * @brief Put lunch token table into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_lunch_tokens(nvds_lunch_tokens_t const *data);
+
+/**
+ * @brief Get energy counters from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_energy(nvds_energy_t *out);
+
+/**
+ * @brief Put energy counters into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_energy(nvds_energy_t const *data);
+
+/**
+ * @brief Get lunch window schedule from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_lunch_sched(nvds_lunch_sched_t *out);
+
+/**
+ * @brief Put lunch window schedule into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_lunch_sched(nvds_lunch_sched_t const *data);
+
+/**
+ * @brief Get the time of week clock from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_lunch_clock(nvds_lunch_clock_t *out);
+
+/**
+ * @brief Put the time of week clock into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_lunch_clock(nvds_lunch_clock_t const *data);
+
+/**
+ * @brief Get the raw PMU_WURX block the WuRX driver is configured from
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_pmu_wurx(uint8_t *out, nvds_tag_len_t *len);
+
+/**
+ * @brief Put the raw PMU_WURX block, used from the next boot on
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_pmu_wurx(uint8_t *data, nvds_tag_len_t len);
+
+/**
+ * @brief Get WuRX tuning record from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_wurx_tune(nvds_wurx_tune_t *out);
+
+/**
+ * @brief Put WuRX tuning record into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_wurx_tune(nvds_wurx_tune_t const *data);
+
+/**
+ * @brief Get the accept list of provisioning station addresses
+ * @note 6 bytes per address, len is set to the bytes read
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_conn_accept(uint8_t *out, nvds_tag_len_t *len);
+
+/**
+ * @brief Get learned lunch adv duration record from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_adv_learn(nvds_adv_learn_t *out);
+
+/**
+ * @brief Put learned lunch adv duration record into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_adv_learn(nvds_adv_learn_t const *data);
+
+/**
+ * @brief Get OTA transfer record from nvds tag
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_get_ota(nvds_ota_t *out);
+
+/**
+ * @brief Put OTA transfer record into nvds
+ * @returns NVDS_OK on success
+*/
+uint8_t nvds_put_ota(nvds_ota_t const *data);
+
+/**
+ * @brief Get the key OTA images are MACed with
+ * @note Written at the factory only, nothing reads it over the air
+ * @returns NVDS_OK if a key of LUNCH_OTA_KEY_LEN bytes is there
+*/
+uint8_t nvds_get_ota_key(uint8_t *out);
+
 /**
  * @brief Print nvds lunch data
  */
@@ -0,0 +1,521 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_ota.c
+ *
+ * @brief Delta firmware updates into a staged image slot
+ *
+ * The provisioning station sends a delta made by tools/ota_delta.py against
+ * the image we are running. The delta is decoded as it arrives, copying
+ * unchanged runs from the running image and taking the rest from the
+ * delta, and the result is written straight into the slot. Nothing but the
+ * decoder state is kept in RAM, and that is saved to nvds now and then so a
+ * dropped connection only costs the last few kB. Once the whole image is in
+ * the slot its CRC and its HMAC under the fleet key have to match before it
+ * can be installed, and only a central on the accept list may drive any of
+ * it. The CRCs of the base and of the image and the MAC run a few kB per
+ * timer tick, never in a GATT write.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "arch.h"
+#include "nvds.h"
+#include "flash.h"
+#include "sw_timer.h"
+#include "atm_log.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_ota.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_sleep.h"
+#include "lunch_sha256.h"
+#include "lunch_conn.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_ota", V);
+
+enum {
+    PH_OP,
+    PH_ARG,
+    PH_DATA,
+    PH_FILL,
+};
+
+enum {
+    CHECK_NONE,
+    CHECK_BASE,  // running image against a new START
+    CHECK_IMAGE, // slot against the image CRC
+};
+
+#define COPY_BUF_LEN 64
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static nvds_ota_t ota;
+static bool loaded;
+static uint32_t ckpt_ofs;
+static lunch_ota_status_t status;
+static sw_timer_id_t check_tid;
+static uint8_t checking;
+static uint32_t check_ofs;
+static uint32_t check_crc;
+static lunch_ota_start_t pending;
+static lunch_hmac_sha256_t mac;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+// All flash access goes through here, slot offsets are relative to the slot
+static bool run_read(uint32_t ofs, uint8_t *buf, uint32_t len)
+{
+    return !flash_read(CFG_LUNCH_OTA_RUN_ADDR + ofs, len, buf);
+}
+
+static bool slot_read(uint32_t ofs, uint8_t *buf, uint32_t len)
+{
+    return !flash_read(CFG_LUNCH_OTA_SLOT_ADDR + ofs, len, buf);
+}
+
+// Output is written in order, so a sector is erased when we first get to it.
+// After a resume the bytes since the last checkpoint are written again with
+// the same values
+static bool slot_write(uint8_t const *buf, uint32_t len)
+{
+    if (ota.out_ofs + len > ota.start.image_len) {
+        return false;
+    }
+
+    while (len) {
+        uint32_t sector_left = CFG_LUNCH_OTA_SECTOR - ota.out_ofs % CFG_LUNCH_OTA_SECTOR;
+        uint32_t n = len < sector_left ? len : sector_left;
+        uint32_t addr = CFG_LUNCH_OTA_SLOT_ADDR + ota.out_ofs;
+        if (!(ota.out_ofs % CFG_LUNCH_OTA_SECTOR) && flash_erase(addr, CFG_LUNCH_OTA_SECTOR)) {
+            return false;
+        }
+        if (flash_write(addr, n, buf)) {
+            return false;
+        }
+        ota.out_ofs += n;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static uint32_t crc32_update(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    while (len--) {
+        crc ^= *buf++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+static void save(void)
+{
+    nvds_put_ota(&ota);
+    ckpt_ofs = ota.in_ofs;
+}
+
+static void load(void)
+{
+    if (loaded) {
+        return;
+    }
+    loaded = true;
+
+    if (nvds_get_ota(&ota) != NVDS_OK) {
+        memset(&ota, 0, sizeof(ota));
+    }
+    ckpt_ofs = ota.in_ofs;
+}
+
+static void fail(void)
+{
+    LUNCH_LOG(W, LL_OTA_FAIL, "OTA failed at delta %lu, image %lu", ota.in_ofs, ota.out_ofs);
+    ota.state = LUNCH_OTA_FAILED;
+    save();
+}
+
+static bool key_ok(void)
+{
+    uint8_t key[LUNCH_OTA_KEY_LEN];
+    bool ok = nvds_get_ota_key(key) == NVDS_OK;
+    memset(key, 0, sizeof(key));
+    if (!ok) {
+        LUNCH_LOG(W, LL_OTA_NO_KEY, "No OTA key, updates refused");
+    }
+    return ok;
+}
+
+// Constant time, so the MAC can't be guessed a byte at a time
+static bool mac_equal(uint8_t const *a, uint8_t const *b)
+{
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < LUNCH_OTA_MAC_LEN; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return !diff;
+}
+
+static void check_begin(uint8_t what)
+{
+    if (what == CHECK_IMAGE) {
+        uint8_t key[LUNCH_OTA_KEY_LEN];
+        if (nvds_get_ota_key(key) != NVDS_OK) {
+            fail();
+            return;
+        }
+        lunch_hmac_sha256_init(&mac, key, sizeof(key));
+        memset(key, 0, sizeof(key));
+    }
+
+    checking = what;
+    check_ofs = 0;
+    check_crc = 0xFFFFFFFF;
+    sw_timer_set(check_tid, 1);
+}
+
+static void check_cancel(void)
+{
+    checking = CHECK_NONE;
+    sw_timer_clear(check_tid);
+    memset(&mac, 0, sizeof(mac));
+}
+
+static void check_done(bool ok)
+{
+    uint8_t what = checking;
+    checking = CHECK_NONE;
+
+    if (what == CHECK_BASE) {
+        if (!ok) {
+            LUNCH_LOG(W, LL_OTA_BAD_BASE, "OTA delta is not for this image");
+            return;
+        }
+        memset(&ota, 0, sizeof(ota));
+        ota.start = pending;
+        ota.state = LUNCH_OTA_RECEIVING;
+        save();
+        LUNCH_LOG(D, LL_OTA_START, "OTA start, delta %lu bytes for image %lu bytes",
+            ota.start.delta_len, ota.start.image_len);
+        return;
+    }
+
+    uint8_t image_mac[LUNCH_OTA_MAC_LEN];
+    lunch_hmac_sha256_final(&mac, image_mac);
+    if (!ok || !mac_equal(image_mac, ota.start.image_mac)) {
+        fail();
+        return;
+    }
+    LUNCH_LOG(D, LL_OTA_VERIFIED, "OTA image verified, %lu bytes crc=%#lx",
+        ota.start.image_len, ota.start.image_crc);
+    ota.state = LUNCH_OTA_VERIFIED;
+    save();
+}
+
+// CRC the next CFG_LUNCH_OTA_CHECK_BYTES, so the stack gets to run between
+static void check_timer(sw_timer_id_t timer_id, const void *ctx)
+{
+    sw_timer_clear(check_tid);
+    if (checking == CHECK_NONE) {
+        return;
+    }
+
+    bool base = checking == CHECK_BASE;
+    bool (*read)(uint32_t, uint8_t *, uint32_t) = base ? run_read : slot_read;
+    uint32_t len = base ? pending.base_len : ota.start.image_len;
+    uint32_t end = len - check_ofs < CFG_LUNCH_OTA_CHECK_BYTES ? len : check_ofs + CFG_LUNCH_OTA_CHECK_BYTES;
+
+    uint8_t buf[COPY_BUF_LEN];
+    while (check_ofs < end) {
+        uint32_t n = end - check_ofs < sizeof(buf) ? end - check_ofs : sizeof(buf);
+        if (!read(check_ofs, buf, n)) {
+            check_done(false);
+            return;
+        }
+        check_crc = crc32_update(check_crc, buf, n);
+        if (!base) {
+            lunch_hmac_sha256_update(&mac, buf, n);
+        }
+        check_ofs += n;
+    }
+
+    if (check_ofs < len) {
+        sw_timer_set(check_tid, 1);
+        return;
+    }
+    check_done(~check_crc == (base ? pending.base_crc : ota.start.image_crc));
+}
+
+static bool op_copy(uint32_t src, uint32_t len)
+{
+    if (src + len > ota.start.base_len || src + len < src) {
+        return false;
+    }
+
+    uint8_t buf[COPY_BUF_LEN];
+    while (len) {
+        uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (!run_read(src, buf, n) || !slot_write(buf, n)) {
+            return false;
+        }
+        src += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool op_fill(uint8_t val, uint32_t len)
+{
+    uint8_t buf[COPY_BUF_LEN];
+    memset(buf, val, sizeof(buf));
+    while (len) {
+        uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+        if (!slot_write(buf, n)) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+static uint8_t op_args(uint8_t op)
+{
+    return op == LUNCH_OTA_OP_COPY ? 2 : 1;
+}
+
+// Feed delta bytes to the decoder, returns how many were used or -1
+static int32_t decode(uint8_t const *p, uint32_t len)
+{
+    uint32_t used = 0;
+    while (used < len) {
+        switch (ota.phase) {
+            case PH_OP: {
+                ota.op = p[used++];
+                if (ota.op < LUNCH_OTA_OP_COPY || ota.op > LUNCH_OTA_OP_FILL) {
+                    return -1;
+                }
+                ota.arg[0] = ota.arg[1] = 0;
+                ota.argn = 0;
+                ota.shift = 0;
+                ota.phase = PH_ARG;
+            } break;
+            case PH_ARG: {
+                // LEB128
+                uint8_t b = p[used++];
+                if (ota.shift > 28) {
+                    return -1;
+                }
+                ota.arg[ota.argn] |= (uint32_t) (b & 0x7F) << ota.shift;
+                ota.shift += 7;
+                if (b & 0x80) {
+                    break;
+                }
+                ota.shift = 0;
+                if (++ota.argn < op_args(ota.op)) {
+                    break;
+                }
+
+                if (ota.op == LUNCH_OTA_OP_COPY) {
+                    if (!op_copy(ota.arg[0], ota.arg[1])) {
+                        return -1;
+                    }
+                    ota.phase = PH_OP;
+                } else if (ota.op == LUNCH_OTA_OP_INSERT) {
+                    ota.left = ota.arg[0];
+                    ota.phase = ota.left ? PH_DATA : PH_OP;
+                } else {
+                    ota.phase = PH_FILL;
+                }
+            } break;
+            case PH_DATA: {
+                uint32_t n = len - used < ota.left ? len - used : ota.left;
+                if (!slot_write(p + used, n)) {
+                    return -1;
+                }
+                used += n;
+                ota.left -= n;
+                if (!ota.left) {
+                    ota.phase = PH_OP;
+                }
+            } break;
+            case PH_FILL: {
+                if (!op_fill(p[used++], ota.arg[0])) {
+                    return -1;
+                }
+                ota.phase = PH_OP;
+            } break;
+        }
+    }
+    return used;
+}
+
+static void verify(void)
+{
+    if (ota.phase != PH_OP || ota.out_ofs != ota.start.image_len) {
+        fail();
+        return;
+    }
+    check_begin(CHECK_IMAGE);
+}
+
+// Addresses can be spoofed, this keeps passing phones out. What makes an
+// image trusted is its MAC
+static bool listed(void)
+{
+    if (!lunch_conn_listed()) {
+        LUNCH_LOG(W, LL_OTA_NOT_LISTED, "OTA refused, central not on the accept list");
+        return false;
+    }
+    return true;
+}
+
+static bool start(lunch_ota_start_t const *req)
+{
+    if (checking != CHECK_NONE) {
+        return false;
+    }
+
+    // Same image again, go on from where we were. The whole delta may be in
+    // already if we dropped during the image check
+    if (ota.state == LUNCH_OTA_RECEIVING && !memcmp(&ota.start, req, sizeof(*req))) {
+        LUNCH_LOG(D, LL_OTA_RESUME, "OTA resumes at delta %lu", ota.in_ofs);
+        if (ota.in_ofs == ota.start.delta_len) {
+            verify();
+        }
+        return true;
+    }
+
+    if (!key_ok()) {
+        return false;
+    }
+    if (!req->image_len || req->image_len > CFG_LUNCH_OTA_SLOT_SIZE ||
+        !req->base_len || req->base_len > CFG_LUNCH_OTA_RUN_SIZE) {
+        LUNCH_LOG(W, LL_OTA_BAD_START, "OTA start out of bounds, base %lu image %lu",
+            req->base_len, req->image_len);
+        return false;
+    }
+
+    // The saved transfer stays until the base checks out
+    pending = *req;
+    check_begin(CHECK_BASE);
+    return true;
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_ota_init(void)
+{
+    check_tid = sw_timer_alloc(check_timer, NULL);
+    lunch_sleep_reg_timer(SLEEP_TIMER_OTA_CHECK, check_tid);
+}
+
+bool lunch_ota_ctrl(uint8_t const *data, uint16_t len)
+{
+    load();
+    if (!len || !listed()) {
+        return false;
+    }
+
+    switch (data[0]) {
+        case LUNCH_OTA_CMD_START: {
+            lunch_ota_start_t req;
+            if (len != 1 + sizeof(req)) {
+                return false;
+            }
+            memcpy(&req, data + 1, sizeof(req));
+            return start(&req);
+        }
+        case LUNCH_OTA_CMD_ABORT: {
+            check_cancel();
+            memset(&ota, 0, sizeof(ota));
+            save();
+            return true;
+        }
+        case LUNCH_OTA_CMD_INSTALL: {
+            if (ota.state != LUNCH_OTA_VERIFIED) {
+                return false;
+            }
+            LUNCH_LOG(D, LL_OTA_INSTALL, "OTA install");
+            lunch_log_drain();
+            return lunch_ota_port_install(CFG_LUNCH_OTA_SLOT_ADDR, ota.start.image_len);
+        }
+        default: break;
+    }
+    return false;
+}
+
+bool lunch_ota_data(uint8_t const *data, uint16_t len)
+{
+    load();
+    if (!listed()) {
+        return false;
+    }
+
+    uint32_t ofs;
+    if (ota.state != LUNCH_OTA_RECEIVING || checking != CHECK_NONE || len <= sizeof(ofs) ||
+        len - sizeof(ofs) > CFG_LUNCH_OTA_CHUNK_MAX) {
+        return false;
+    }
+    memcpy(&ofs, data, sizeof(ofs));
+    data += sizeof(ofs);
+    len -= sizeof(ofs);
+
+    if (ofs != ota.in_ofs || ofs + len > ota.start.delta_len) {
+        return false;
+    }
+
+    if (decode(data, len) < 0) {
+        fail();
+        return false;
+    }
+    ota.in_ofs += len;
+
+    if (ota.in_ofs == ota.start.delta_len) {
+        verify();
+    } else if (ota.in_ofs - ckpt_ofs >= CFG_LUNCH_OTA_CKPT_BYTES) {
+        save();
+    }
+    return true;
+}
+
+lunch_ota_status_t const *lunch_ota_status(void)
+{
+    load();
+    status.state = checking != CHECK_NONE ? LUNCH_OTA_CHECKING : ota.state;
+    status.in_ofs = ota.in_ofs;
+    status.delta_len = ota.start.delta_len;
+    status.out_ofs = ota.out_ofs;
+    status.chunk_max = CFG_LUNCH_OTA_CHUNK_MAX;
+    return &status;
+}
+
+void lunch_ota_suspend(void)
+{
+    check_cancel();
+    if (loaded && ota.state == LUNCH_OTA_RECEIVING && ota.in_ofs != ckpt_ofs) {
+        save();
+    }
+}
+
+__WEAK bool lunch_ota_port_install(uint32_t slot_addr, uint32_t len)
+{
+    LUNCH_LOG(W, LL_OTA_NO_BOOTLOADER, "No bootloader to install the OTA image");
+    return false;
+}
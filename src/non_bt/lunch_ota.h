@@ -0,0 +1,149 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_ota.h
+ *
+ * @brief Delta firmware updates into a staged image slot
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "arch.h"
+
+// Control characteristic commands
+#define LUNCH_OTA_CMD_START 0x01
+#define LUNCH_OTA_CMD_ABORT 0x02
+#define LUNCH_OTA_CMD_INSTALL 0x03
+
+// Delta ops, keep tools/ota_delta.py in sync
+#define LUNCH_OTA_OP_COPY 0x01   // src offset, len: copy from the running image
+#define LUNCH_OTA_OP_INSERT 0x02 // len, then len literal bytes
+#define LUNCH_OTA_OP_FILL 0x03   // len, then one byte repeated len times
+
+// HMAC-SHA256 of the image under the fleet key in NVDS tag 0xDA
+#define LUNCH_OTA_KEY_LEN 32
+#define LUNCH_OTA_MAC_LEN 32
+
+typedef enum {
+    LUNCH_OTA_IDLE,
+    LUNCH_OTA_RECEIVING,
+    LUNCH_OTA_VERIFIED,
+    LUNCH_OTA_FAILED,
+    LUNCH_OTA_CHECKING, // CRC of the base or the image running, poll again
+} lunch_ota_state_t;
+
+/**
+ * @brief Start command, after the command byte
+ * @note The same header starts every delta file from tools/ota_delta.py
+ */
+typedef struct {
+    uint32_t base_len;  // running image the delta was made against
+    uint32_t base_crc;
+    uint32_t image_len; // image the delta builds
+    uint32_t image_crc;
+    uint32_t delta_len; // delta ops, without this header
+    uint8_t image_mac[LUNCH_OTA_MAC_LEN];
+} __PACKED lunch_ota_start_t;
+
+/**
+ * @brief NVDS OTA transfer record
+ * @note Saved every CFG_LUNCH_OTA_CKPT_BYTES and on disconnect, so a
+ * transfer picks up where it was after a reconnect or a hibernation
+ */
+typedef struct {
+    lunch_ota_start_t start;
+    uint32_t in_ofs;  // next delta byte we expect
+    uint32_t out_ofs; // next slot byte we write
+    // Delta decoder, so we can stop in the middle of an op
+    uint32_t arg[2];
+    uint32_t left;
+    uint8_t op;
+    uint8_t phase;
+    uint8_t argn;
+    uint8_t shift;
+    uint8_t state;
+} __PACKED nvds_ota_t;
+
+/**
+ * @brief Value of the control characteristic
+ * @note chunk_max is the most delta bytes a data write may carry, the host
+ * sends less if its MTU is smaller
+ */
+typedef struct {
+    uint8_t state;
+    uint32_t in_ofs;
+    uint32_t delta_len;
+    uint32_t out_ofs;
+    uint16_t chunk_max;
+} __PACKED lunch_ota_status_t;
+
+#ifdef CFG_LUNCH_OTA
+
+/**
+ *******************************************************************************
+ * @brief Allocate the timer the CRC checks run on
+ *******************************************************************************
+ */
+void lunch_ota_init(void);
+
+/**
+ *******************************************************************************
+ * @brief Handle a write to the control characteristic
+ * @note Only a central on the accept list may write, and only to a tag with
+ * an OTA key. START with the same image as a saved transfer resumes it. A new
+ * START is accepted while its base is still being checked, the state reads
+ * checking until then and receiving or idle after
+ * @returns false if the command was refused
+ *******************************************************************************
+ */
+bool lunch_ota_ctrl(uint8_t const *data, uint16_t len);
+
+/**
+ *******************************************************************************
+ * @brief Handle a write to the data characteristic
+ * @note 4 byte little endian delta offset, then delta bytes. A write at any
+ * other offset than the next one is refused, read the status and go on
+ * from there. Only a central on the accept list may write
+ * @returns false if the chunk was refused
+ *******************************************************************************
+ */
+bool lunch_ota_data(uint8_t const *data, uint16_t len);
+
+/**
+ *******************************************************************************
+ * @brief Current transfer status
+ *******************************************************************************
+ */
+lunch_ota_status_t const *lunch_ota_status(void);
+
+/**
+ *******************************************************************************
+ * @brief Save the transfer so it can resume
+ * @note Call when the central disconnects, a CRC check still running is
+ * dropped and runs again on the next START
+ *******************************************************************************
+ */
+void lunch_ota_suspend(void);
+
+#else
+
+static inline void lunch_ota_init(void) {}
+static inline void lunch_ota_suspend(void) {}
+
+#endif // CFG_LUNCH_OTA
+
+/**
+ *******************************************************************************
+ * @brief Hand the verified slot to the bootloader and reset
+ * @note Weak, the default refuses. A board with a bootloader that boots from
+ * the slot overrides it
+ * @returns false if the image could not be installed
+ *******************************************************************************
+ */
+bool lunch_ota_port_install(uint32_t slot_addr, uint32_t len);
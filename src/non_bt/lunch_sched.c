@@ -0,0 +1,309 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sched.c
+ *
+ * @brief Weekly lunch window schedule
+ *
+ * Outside the lunch windows nobody is at the gate, so WuRX is switched off
+ * and the tag hibernates on a timer until the next window. The time of week
+ * comes from the sleep timer. It is set over GATT while pairing and pulled
+ * back whenever the gate is heard near the edge of a window.
+ *
+ * The clock also adds up the time spent hibernating for the energy record,
+ * across the timer wakes that don't save it.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "arch.h"
+#include "nvds.h"
+#include "timer.h"
+#include "atm_log.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_sched.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+#include "lunch_wake.h"
+#include "lunch_wurx_tune.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_sched", V);
+
+// pseq_dur counts sleep clock ticks
+#define PSEQ_TICKS_PER_S 32768
+// Longest timer pseq_dur can hold
+#define MAX_TIMER_S (INT32_MAX / PSEQ_TICKS_PER_S)
+// The sys time wraps after this long
+#define SYS_WRAP_S (UINT32_MAX / 1000000)
+// Timer wakes land this close to when we asked for
+#define TIMER_SLACK_US 2000000
+#define GUARD_S (CFG_LUNCH_SCHED_GUARD_MIN * 60)
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static nvds_lunch_sched_t sched;
+static nvds_lunch_clock_t lunch_clock;
+
+// Decided in lunch_sched_on_sleep, used by the prevent hibernation vector
+static bool next_wurx_on = true;
+static uint32_t next_timer_s;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH static uint32_t advance_clock(void)
+{
+    uint32_t now = atm_get_sys_time();
+    uint32_t secs = (now - lunch_clock.sys_time) / 1000000;
+
+    lunch_clock.week_s = (lunch_clock.week_s + secs) % LUNCH_SCHED_WEEK_S;
+    // Keep the sub second remainder for next time
+    lunch_clock.sys_time += secs * 1000000;
+    return secs;
+}
+
+static bool sched_active(void)
+{
+    return lunch_clock.synced && sched.count;
+}
+
+/*
+ * @brief Find where the time of week is relative to the windows
+ * @param[in] guard  Widen every window by this much on both sides (unit of s)
+ * @param[out] edge_s  Seconds to the end of the window we are in, or to the
+ * start of the next window
+ * @param[out] pos_s  Inside a window, seconds since its real start (negative
+ * in the leading guard)
+ * @returns true if inside a window
+ */
+static bool find_window(uint32_t now, uint32_t guard, uint32_t *edge_s, int32_t *pos_s)
+{
+    uint32_t next_start = LUNCH_SCHED_WEEK_S;
+
+    for (uint8_t w = 0; w < sched.count; w++) {
+        lunch_window_t const *win = &sched.window[w];
+        if (win->end_min <= win->start_min) {
+            continue;
+        }
+        uint32_t len = (win->end_min - win->start_min) * 60 + 2 * guard;
+
+        for (uint8_t day = 0; day < 7; day++) {
+            if (!(win->days & (1 << day))) {
+                continue;
+            }
+            uint32_t start = (day * LUNCH_SCHED_DAY_S + win->start_min * 60 +
+                LUNCH_SCHED_WEEK_S - guard) % LUNCH_SCHED_WEEK_S;
+            uint32_t since = (now + LUNCH_SCHED_WEEK_S - start) % LUNCH_SCHED_WEEK_S;
+
+            if (since < len) {
+                *edge_s = len - since;
+                if (pos_s) {
+                    *pos_s = (int32_t) since - (int32_t) guard;
+                }
+                return true;
+            }
+
+            uint32_t until = LUNCH_SCHED_WEEK_S - since;
+            if (until < next_start) {
+                next_start = until;
+            }
+        }
+    }
+
+    *edge_s = next_start;
+    return false;
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+__WAKE_PATH bool lunch_sched_on_wake(void)
+{
+    if (nvds_get_lunch_sched(&sched) != NVDS_OK) {
+        sched.count = 0;
+    }
+
+    // A cold boot means the battery was out, the time of week is gone
+    if (boot_was_cold() || nvds_get_lunch_clock(&lunch_clock) != NVDS_OK) {
+        memset(&lunch_clock, 0, sizeof(lunch_clock));
+        lunch_clock.sys_time = atm_get_sys_time();
+        nvds_put_lunch_clock(&lunch_clock);
+        return false;
+    }
+
+    // Both wrap the same way, so a timer wake matches even past the wrap
+    uint32_t elapsed_us = atm_get_sys_time() - lunch_clock.sys_time;
+    uint32_t timer_us = lunch_clock.timer_s * 1000000UL;
+    bool timer_wake = lunch_clock.timer_s &&
+        elapsed_us - timer_us + TIMER_SLACK_US < 2 * TIMER_SLACK_US;
+
+    uint32_t slept_s;
+    if (timer_wake) {
+        // The timer is exact, the sys time may have wrapped
+        slept_s = lunch_clock.timer_s;
+        lunch_clock.week_s = (lunch_clock.week_s + slept_s) % LUNCH_SCHED_WEEK_S;
+        lunch_clock.sys_time = atm_get_sys_time();
+    } else {
+        // WuRX only listens under the wrap, so this is exact unless the
+        // button cut a long timer short
+        slept_s = advance_clock();
+        if (lunch_clock.timer_s > SYS_WRAP_S && lunch_clock.synced) {
+            lunch_clock.synced = false;
+            LUNCH_LOG(D, LL_SCHED_LOST, "Button wake %lus into a %lus timer, clock lost",
+                slept_s, lunch_clock.timer_s);
+        }
+    }
+
+    // Only a cold boot sleeps without a timer, with WuRX off until the
+    // button, and that shelf time is not charged
+    if (lunch_clock.timer_s) {
+        lunch_clock.hib_s += slept_s;
+    }
+
+    LUNCH_LOG(D, LL_SCHED_WAKE, "lunch_sched_on_wake: week_s=%lu slept=%lu timer=%d",
+        lunch_clock.week_s, slept_s, timer_wake);
+
+    return timer_wake;
+}
+
+void lunch_sched_gate_contact(void)
+{
+    if (!sched_active()) {
+        return;
+    }
+
+    advance_clock();
+
+    uint32_t edge_s;
+    int32_t pos_s;
+    if (!find_window(lunch_clock.week_s, GUARD_S, &edge_s, &pos_s)) {
+        // Heard the gate well outside any window, the schedule is wrong
+        // rather than the lunch_clock. Leave it for the next time sync
+        return;
+    }
+
+    // The gate only runs inside the window. If we think it hasn't started
+    // yet our clock is behind, if we think it is over our clock is ahead
+    int32_t len_s = (int32_t) edge_s + pos_s - GUARD_S;
+    int32_t corr_s = 0;
+    if (pos_s < 0) {
+        corr_s = -pos_s;
+    } else if (pos_s > len_s) {
+        corr_s = len_s - pos_s;
+    }
+
+    if (corr_s) {
+        lunch_clock.week_s = (lunch_clock.week_s + LUNCH_SCHED_WEEK_S + corr_s) % LUNCH_SCHED_WEEK_S;
+        LUNCH_LOG(D, LL_SCHED_RESYNC, "Gate contact moved clock by %lds", corr_s);
+    }
+}
+
+bool lunch_sched_on_sleep(void)
+{
+    bool was_in_window = sched_active() && lunch_clock.wurx_on;
+
+    next_wurx_on = true;
+    next_timer_s = 0;
+
+    // Start the hibernation from here, not from the last wake
+    advance_clock();
+
+    if (sched_active()) {
+        uint32_t edge_s;
+        next_wurx_on = find_window(lunch_clock.week_s, GUARD_S, &edge_s, NULL);
+        next_timer_s = edge_s;
+    } else {
+        // Windows end the WuRX tuning otherwise, without them it needs a timer
+        next_timer_s = lunch_wurx_tune_timer_s();
+    }
+
+    // With WuRX on the wake may come from the gate and is timed by the 32
+    // bit sys time, wake up before it wraps even without a schedule. With it
+    // off the timer itself says how long we slept, go straight to the window
+    uint32_t max_s = next_wurx_on ? CFG_LUNCH_SCHED_MAX_HIB_S : MAX_TIMER_S;
+    if (!next_timer_s || next_timer_s > max_s) {
+        next_timer_s = max_s;
+    }
+
+    LUNCH_LOG(D, LL_SCHED_SLEEP, "lunch_sched_on_sleep: week_s=%lu wurx=%d timer=%lus",
+        lunch_clock.week_s, next_wurx_on, next_timer_s);
+
+    lunch_clock.timer_s = next_timer_s;
+    lunch_clock.wurx_on = next_wurx_on;
+    nvds_put_lunch_clock(&lunch_clock);
+
+    return was_in_window && !next_wurx_on;
+}
+
+__FAST bool lunch_sched_prevent_hib(int32_t *pseq_dur)
+{
+    if (next_timer_s) {
+        int32_t dur = (int32_t) next_timer_s * PSEQ_TICKS_PER_S;
+        if (!*pseq_dur || dur < *pseq_dur) {
+            *pseq_dur = dur;
+        }
+    }
+
+    return next_wurx_on;
+}
+
+uint32_t lunch_sched_take_hib_s(void)
+{
+    uint32_t hib_s = lunch_clock.hib_s;
+    lunch_clock.hib_s = 0;
+    return hib_s;
+}
+
+void lunch_sched_set_time(uint32_t week_s)
+{
+    lunch_clock.week_s = week_s % LUNCH_SCHED_WEEK_S;
+    lunch_clock.sys_time = atm_get_sys_time();
+    lunch_clock.synced = true;
+
+    LUNCH_LOG(D, LL_SCHED_SYNC, "lunch_sched_set_time: week_s=%lu", lunch_clock.week_s);
+}
+
+uint32_t lunch_sched_get_time(void)
+{
+    if (!lunch_clock.synced) {
+        return LUNCH_SCHED_WEEK_S;
+    }
+
+    advance_clock();
+    return lunch_clock.week_s;
+}
+
+uint8_t lunch_sched_set(nvds_lunch_sched_t const *new_sched)
+{
+    if (new_sched->count > LUNCH_SCHED_MAX_WINDOWS) {
+        return NVDS_FAIL;
+    }
+
+    for (uint8_t w = 0; w < new_sched->count; w++) {
+        lunch_window_t const *win = &new_sched->window[w];
+        if (win->start_min >= win->end_min || win->end_min > 24 * 60 || (win->days & 0x80)) {
+            ATM_LOG(W, "%s: bad window %d", __func__, w);
+            return NVDS_FAIL;
+        }
+    }
+
+    sched = *new_sched;
+    return nvds_put_lunch_sched(&sched);
+}
+
+nvds_lunch_sched_t const *lunch_sched_get(void)
+{
+    return &sched;
+}
@@ -0,0 +1,130 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sched.h
+ *
+ * @brief Weekly lunch window schedule
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "arch.h"
+
+#define LUNCH_SCHED_MAX_WINDOWS 8
+#define LUNCH_SCHED_DAY_S 86400
+#define LUNCH_SCHED_WEEK_S (7 * LUNCH_SCHED_DAY_S)
+
+/**
+ * @brief One lunch window, repeated on every day set in days
+ * @note Times are local minutes since midnight, days bit 0 is Monday
+ */
+typedef struct {
+    uint8_t days;
+    uint16_t start_min;
+    uint16_t end_min;
+} __PACKED lunch_window_t;
+
+/**
+ * @brief NVDS Lunch Schedule
+ * @note Also the value of the schedule characteristic. No windows means
+ * always listen, same as before there was a schedule
+ */
+typedef struct {
+    uint8_t count;
+    lunch_window_t window[LUNCH_SCHED_MAX_WINDOWS];
+} __PACKED nvds_lunch_sched_t;
+
+/**
+ * @brief NVDS Lunch Clock
+ * @note Coarse time of week carried across hibernation by the sleep timer
+ */
+typedef struct {
+    uint32_t week_s;   // seconds since Monday 00:00 at sys_time
+    uint32_t sys_time; // sys time week_s was last advanced at
+    uint32_t timer_s;  // hibernation length we asked for, 0 if none
+    uint8_t synced;
+    uint8_t wurx_on;   // WuRX was listening during this hibernation
+    uint32_t hib_s;    // hibernation not yet taken by the energy record
+} __PACKED nvds_lunch_clock_t;
+
+/**
+ *******************************************************************************
+ * @brief Load the schedule and advance the clock over the last hibernation
+ * @returns true if the schedule timer woke us (not WuRX or the button)
+ *******************************************************************************
+ */
+bool lunch_sched_on_wake(void);
+
+/**
+ *******************************************************************************
+ * @brief The gate was heard, pull the clock back into a window if it drifted
+ *******************************************************************************
+ */
+void lunch_sched_gate_contact(void);
+
+/**
+ *******************************************************************************
+ * @brief Decide WuRX and the wake timer for the next hibernation and save
+ * the clock
+ * @note Call right before hibernation
+ * @returns true if a lunch window ended since the last hibernation
+ *******************************************************************************
+ */
+bool lunch_sched_on_sleep(void);
+
+/**
+ *******************************************************************************
+ * @brief Apply the decision from lunch_sched_on_sleep
+ * @note Called from the prevent hibernation vector
+ *
+ * @param[in,out] pseq_dur  Hibernation duration, shortened to the next edge
+ * @returns true if WuRX should listen during this hibernation
+ *******************************************************************************
+ */
+bool lunch_sched_prevent_hib(int32_t *pseq_dur);
+
+/**
+ *******************************************************************************
+ * @brief Take the hibernation time added up since the last call
+ * @note The clock keeps it until then, so timer wakes need not save energy
+ * @returns Seconds spent hibernating
+ *******************************************************************************
+ */
+uint32_t lunch_sched_take_hib_s(void);
+
+/**
+ *******************************************************************************
+ * @brief Set the time of week
+ *
+ * @param[in] week_s  Local seconds since Monday 00:00
+ *******************************************************************************
+ */
+void lunch_sched_set_time(uint32_t week_s);
+
+/**
+ *******************************************************************************
+ * @brief Current time of week, LUNCH_SCHED_WEEK_S if never synced
+ *******************************************************************************
+ */
+uint32_t lunch_sched_get_time(void);
+
+/**
+ *******************************************************************************
+ * @brief Validate and store a new schedule
+ * @returns NVDS_OK on success
+ *******************************************************************************
+ */
+uint8_t lunch_sched_set(nvds_lunch_sched_t const *sched);
+
+/**
+ *******************************************************************************
+ * @brief Get the current schedule
+ *******************************************************************************
+ */
+nvds_lunch_sched_t const *lunch_sched_get(void);
@@ -0,0 +1,169 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sha256.c
+ *
+ * @brief SHA-256 and HMAC-SHA256 for checking OTA images
+ *
+ * Plain FIPS 180-4, small rather than fast. It only runs over a staged
+ * image in the OTA check, a few kB per timer tick.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <string.h>
+
+#include "lunch_sha256.h"
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static uint32_t const k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+static void block(lunch_sha256_t *ctx, uint8_t const *p)
+{
+    uint32_t w[64];
+    for (uint8_t i = 0; i < 16; i++) {
+        w[i] = (uint32_t) p[4 * i] << 24 | (uint32_t) p[4 * i + 1] << 16 |
+            (uint32_t) p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (uint8_t i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t v[8];
+    memcpy(v, ctx->h, sizeof(v));
+    for (uint8_t i = 0; i < 64; i++) {
+        uint32_t s1 = ROR(v[4], 6) ^ ROR(v[4], 11) ^ ROR(v[4], 25);
+        uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+        uint32_t t1 = v[7] + s1 + ch + k[i] + w[i];
+        uint32_t s0 = ROR(v[0], 2) ^ ROR(v[0], 13) ^ ROR(v[0], 22);
+        uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+        memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + s0 + maj;
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        ctx->h[i] += v[i];
+    }
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_sha256_init(lunch_sha256_t *ctx)
+{
+    static uint32_t const h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->h, h0, sizeof(h0));
+    ctx->len_lo = ctx->len_hi = 0;
+    ctx->used = 0;
+}
+
+void lunch_sha256_update(lunch_sha256_t *ctx, uint8_t const *data, uint32_t len)
+{
+    ctx->len_lo += len;
+    if (ctx->len_lo < len) {
+        ctx->len_hi++;
+    }
+
+    while (len) {
+        uint32_t n = LUNCH_SHA256_BLOCK - ctx->used;
+        n = len < n ? len : n;
+        memcpy(&ctx->buf[ctx->used], data, n);
+        ctx->used += n;
+        data += n;
+        len -= n;
+        if (ctx->used == LUNCH_SHA256_BLOCK) {
+            block(ctx, ctx->buf);
+            ctx->used = 0;
+        }
+    }
+}
+
+void lunch_sha256_final(lunch_sha256_t *ctx, uint8_t out[LUNCH_SHA256_LEN])
+{
+    uint32_t hi = ctx->len_hi << 3 | ctx->len_lo >> 29;
+    uint32_t lo = ctx->len_lo << 3;
+
+    ctx->buf[ctx->used++] = 0x80;
+    if (ctx->used > LUNCH_SHA256_BLOCK - 8) {
+        memset(&ctx->buf[ctx->used], 0, LUNCH_SHA256_BLOCK - ctx->used);
+        block(ctx, ctx->buf);
+        ctx->used = 0;
+    }
+    memset(&ctx->buf[ctx->used], 0, LUNCH_SHA256_BLOCK - 8 - ctx->used);
+    for (uint8_t i = 0; i < 4; i++) {
+        ctx->buf[56 + i] = hi >> (24 - 8 * i);
+        ctx->buf[60 + i] = lo >> (24 - 8 * i);
+    }
+    block(ctx, ctx->buf);
+
+    for (uint8_t i = 0; i < 8; i++) {
+        out[4 * i] = ctx->h[i] >> 24;
+        out[4 * i + 1] = ctx->h[i] >> 16;
+        out[4 * i + 2] = ctx->h[i] >> 8;
+        out[4 * i + 3] = ctx->h[i];
+    }
+}
+
+void lunch_hmac_sha256_init(lunch_hmac_sha256_t *ctx, uint8_t const *key, uint8_t key_len)
+{
+    memset(ctx->key, 0, sizeof(ctx->key));
+    memcpy(ctx->key, key, key_len < sizeof(ctx->key) ? key_len : sizeof(ctx->key));
+
+    uint8_t pad[LUNCH_SHA256_BLOCK];
+    for (uint8_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = ctx->key[i] ^ 0x36;
+    }
+    lunch_sha256_init(&ctx->inner);
+    lunch_sha256_update(&ctx->inner, pad, sizeof(pad));
+}
+
+void lunch_hmac_sha256_update(lunch_hmac_sha256_t *ctx, uint8_t const *data, uint32_t len)
+{
+    lunch_sha256_update(&ctx->inner, data, len);
+}
+
+void lunch_hmac_sha256_final(lunch_hmac_sha256_t *ctx, uint8_t out[LUNCH_SHA256_LEN])
+{
+    uint8_t digest[LUNCH_SHA256_LEN];
+    lunch_sha256_final(&ctx->inner, digest);
+
+    uint8_t pad[LUNCH_SHA256_BLOCK];
+    for (uint8_t i = 0; i < sizeof(pad); i++) {
+        pad[i] = ctx->key[i] ^ 0x5c;
+    }
+    memset(ctx->key, 0, sizeof(ctx->key));
+
+    lunch_sha256_t outer;
+    lunch_sha256_init(&outer);
+    lunch_sha256_update(&outer, pad, sizeof(pad));
+    lunch_sha256_update(&outer, digest, sizeof(digest));
+    lunch_sha256_final(&outer, out);
+}
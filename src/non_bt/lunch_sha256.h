@@ -0,0 +1,77 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sha256.h
+ *
+ * @brief SHA-256 and HMAC-SHA256 for checking OTA images
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <inttypes.h>
+
+#define LUNCH_SHA256_LEN 32
+#define LUNCH_SHA256_BLOCK 64
+
+typedef struct {
+    uint32_t h[8];
+    uint32_t len_lo; // bytes hashed, 64 bits so the length block is right
+    uint32_t len_hi;
+    uint8_t buf[LUNCH_SHA256_BLOCK];
+    uint8_t used;
+} lunch_sha256_t;
+
+/**
+ * @brief HMAC state, the key is kept for the outer hash
+ */
+typedef struct {
+    lunch_sha256_t inner;
+    uint8_t key[LUNCH_SHA256_BLOCK];
+} lunch_hmac_sha256_t;
+
+/**
+ *******************************************************************************
+ * @brief Start a hash
+ *******************************************************************************
+ */
+void lunch_sha256_init(lunch_sha256_t *ctx);
+
+/**
+ *******************************************************************************
+ * @brief Hash more bytes
+ *******************************************************************************
+ */
+void lunch_sha256_update(lunch_sha256_t *ctx, uint8_t const *data, uint32_t len);
+
+/**
+ *******************************************************************************
+ * @brief Finish the hash into out
+ *******************************************************************************
+ */
+void lunch_sha256_final(lunch_sha256_t *ctx, uint8_t out[LUNCH_SHA256_LEN]);
+
+/**
+ *******************************************************************************
+ * @brief Start an HMAC
+ * @note Keys longer than a block are not supported, the OTA key is 32 bytes
+ *******************************************************************************
+ */
+void lunch_hmac_sha256_init(lunch_hmac_sha256_t *ctx, uint8_t const *key, uint8_t key_len);
+
+/**
+ *******************************************************************************
+ * @brief MAC more bytes
+ *******************************************************************************
+ */
+void lunch_hmac_sha256_update(lunch_hmac_sha256_t *ctx, uint8_t const *data, uint32_t len);
+
+/**
+ *******************************************************************************
+ * @brief Finish the MAC into out and wipe the key from ctx
+ *******************************************************************************
+ */
+void lunch_hmac_sha256_final(lunch_hmac_sha256_t *ctx, uint8_t out[LUNCH_SHA256_LEN]);
@@ -0,0 +1,100 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sleep.c
+ *
+ * @brief Fast teardown between the last adv and hibernation
+ *
+ * Dropping the hibernate lock is not the end of the wake. Pending app timers,
+ * an LED pattern that is still blinking and a full log ring all keep the
+ * device running at full current until they are done. The teardown stops
+ * them in one place, and the time from there to the hibernate vector is
+ * logged along with whatever was still holding us, so the tail can be
+ * watched across builds.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include "arch.h"
+#include "timer.h"
+#include "atm_log.h"
+
+#include "lunch_sleep.h"
+#include "lunch_led.h"
+#include "lunch_button.h"
+#include "lunch_log.h"
+#include "lunch_trace.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_sleep", V);
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static sw_timer_id_t timers[SLEEP_TIMER_NUM];
+static uint32_t timer_mask;
+STATIC_ASSERT(SLEEP_TIMER_NUM <= sizeof(timer_mask) * 8, "Too many sleep timers for timer_mask");
+static uint8_t hold;
+static uint32_t teardown_start;
+static uint32_t teardown_end;
+static bool torn_down;
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_sleep_reg_timer(lunch_sleep_timer_t slot, sw_timer_id_t tid)
+{
+    ASSERT_ERR(slot < SLEEP_TIMER_NUM);
+    timers[slot] = tid;
+    timer_mask |= 1UL << slot;
+}
+
+void lunch_sleep_teardown(void)
+{
+    teardown_start = atm_get_sys_time();
+
+    hold = 0;
+    if (lunch_led_busy()) {
+        hold |= SLEEP_HOLD_LED;
+    }
+    if (lunch_button_held()) {
+        hold |= SLEEP_HOLD_BUTTON;
+    }
+    if (lunch_log_pending()) {
+        hold |= SLEEP_HOLD_LOG;
+    }
+    LUNCH_TRACE(TR_SLEEP, hold, 0);
+
+    // Clearing an idle timer is harmless, cheaper than asking which are armed
+    for (uint8_t i = 0; i < SLEEP_TIMER_NUM; i++) {
+        if (timer_mask & (1UL << i)) {
+            sw_timer_clear(timers[i]);
+        }
+    }
+    lunch_led_off();
+
+    // Empty the ring while we still hold the lock, so the hibernate vector
+    // only has the last few lines left to print
+    lunch_log_drain();
+
+    teardown_end = atm_get_sys_time();
+    torn_down = true;
+}
+
+void lunch_sleep_enter(void)
+{
+    if (!torn_down) {
+        return;
+    }
+    torn_down = false;
+
+    uint32_t now = atm_get_sys_time();
+    LUNCH_LOG(D, LL_SLEEP_TAIL, "Sleep tail: teardown=%luus idle=%luus holders=%#x",
+        teardown_end - teardown_start, now - teardown_end, hold);
+}
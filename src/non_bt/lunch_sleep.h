@@ -0,0 +1,58 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_sleep.h
+ *
+ * @brief Fast teardown between the last adv and hibernation
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include <inttypes.h>
+#include "sw_timer.h"
+
+// Keep in sync with tools/trace2chrome.py
+typedef enum {
+    SLEEP_HOLD_LED = 1 << 0,    // blink pattern still running
+    SLEEP_HOLD_BUTTON = 1 << 1, // button press being timed, holds its own lock
+    SLEEP_HOLD_LOG = 1 << 2,    // log ring not drained yet
+} lunch_sleep_hold_t;
+
+// App timers that must not outlive the wake, one slot each. A new timer
+// needs its own slot here, there is no count to run out of at boot
+typedef enum {
+    SLEEP_TIMER_ADV_START,
+    SLEEP_TIMER_WARM,
+    SLEEP_TIMER_CONN_IDLE,
+    SLEEP_TIMER_CONN_SESSION,
+    SLEEP_TIMER_OTA_CHECK,
+    SLEEP_TIMER_NUM
+} lunch_sleep_timer_t;
+
+/**
+ *******************************************************************************
+ * @brief Add an app timer that must not outlive the wake
+ * @note A pending sw_timer keeps the platform from hibernating, or wakes it
+ * again right after
+ *******************************************************************************
+ */
+void lunch_sleep_reg_timer(lunch_sleep_timer_t slot, sw_timer_id_t tid);
+
+/**
+ *******************************************************************************
+ * @brief Stop everything that would keep us awake and record what it was
+ * @note Call right before dropping the hibernate lock
+ *******************************************************************************
+ */
+void lunch_sleep_teardown(void);
+
+/**
+ *******************************************************************************
+ * @brief Log how long it took from the teardown to the hibernate vector
+ * @note Called from the hibernate vector
+ *******************************************************************************
+ */
+void lunch_sleep_enter(void);
@@ -0,0 +1,86 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_trace.c
+ *
+ * @brief Timestamped state machine trace
+ *
+ * The cycle counter stops while the core sleeps, so every record also has the
+ * sys time to place it on the timeline. Cycles give the exact cost between
+ * points that are close together.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#ifdef CFG_LUNCH_TRACE
+
+#include <stdio.h>
+#include "arch.h"
+#include "timer.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_trace.h"
+
+typedef struct {
+    uint32_t sys_time;
+    uint32_t cycles;
+    uint8_t type;
+    uint8_t a;
+    uint16_t b;
+} lunch_trace_rec_t;
+
+static lunch_trace_rec_t ring[CFG_LUNCH_TRACE_LEN];
+static uint16_t head;
+static uint16_t count;
+static uint16_t lost;
+
+void lunch_trace_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+__FAST void lunch_trace_put(lunch_trace_type_t type, uint8_t a, uint16_t b)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    // Keep the newest records, the tail before hibernation matters most
+    lunch_trace_rec_t *rec = &ring[head];
+    rec->cycles = DWT->CYCCNT;
+    rec->sys_time = atm_get_sys_time();
+    rec->type = type;
+    rec->a = a;
+    rec->b = b;
+
+    head = (head + 1) % CFG_LUNCH_TRACE_LEN;
+    if (count < CFG_LUNCH_TRACE_LEN) {
+        count++;
+    } else {
+        lost++;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+void lunch_trace_dump(void)
+{
+    uint16_t idx = (head + CFG_LUNCH_TRACE_LEN - count) % CFG_LUNCH_TRACE_LEN;
+
+    printf("#E begin %u\n", lost);
+    for (uint16_t i = 0; i < count; i++) {
+        lunch_trace_rec_t const *rec = &ring[idx];
+        printf("#E %08lx %08lx %x %x %x\n", rec->sys_time, rec->cycles,
+            rec->type, rec->a, rec->b);
+        idx = (idx + 1) % CFG_LUNCH_TRACE_LEN;
+    }
+    printf("#E end\n");
+
+    count = 0;
+    lost = 0;
+}
+
+#endif // CFG_LUNCH_TRACE
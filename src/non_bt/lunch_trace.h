@@ -0,0 +1,89 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_trace.h
+ *
+ * @brief Timestamped state machine trace
+ *
+ * With CFG_LUNCH_TRACE each LUNCH_TRACE point stores a small record with the
+ * sys time and the CPU cycle counter in a RAM ring, which stays put in
+ * retention. The ring is dumped before hibernation and
+ * tools/trace2chrome.py turns it into a Chrome/Perfetto timeline.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include "atm_pm.h"
+
+// Keep in sync with tools/trace2chrome.py
+typedef enum {
+    TR_BOOT,        // a: cold
+    TR_STATE,       // a: last state, b: next state | op << 8
+    TR_ADV_STATE,   // a: act_idx, b: adv state
+    TR_GAP,         // a: lunch_trace_gap_t
+    TR_PM_LOCK,     // a: lock id
+    TR_PM_UNLOCK,   // a: lock id
+    TR_NVDS_GET,    // a: tag, b: err
+    TR_NVDS_PUT,    // a: tag, b: err
+    TR_HIB,
+    TR_SLEEP,       // a: lunch_sleep_hold_t mask when we decided to sleep
+    TR_OP_WAIT,     // a: op, b: us it waited in the queue before running
+    TR_NVDS_HIT,    // a: tag, b: err, served from the nvds cache
+} lunch_trace_type_t;
+
+typedef enum {
+    TR_GAP_INIT_CFM,
+    TR_GAP_CONN_IND,
+    TR_GAP_DISC_IND,
+} lunch_trace_gap_t;
+
+#ifdef CFG_LUNCH_TRACE
+
+#define LUNCH_TRACE(type, a, b) lunch_trace_put(type, a, b)
+
+/**
+ *******************************************************************************
+ * @brief Start the cycle counter
+ *******************************************************************************
+ */
+void lunch_trace_init(void);
+
+/**
+ *******************************************************************************
+ * @brief Record a trace point
+ * @note Safe to call from interrupts
+ *******************************************************************************
+ */
+void lunch_trace_put(lunch_trace_type_t type, uint8_t a, uint16_t b);
+
+/**
+ *******************************************************************************
+ * @brief Print the trace ring to the debug UART
+ *******************************************************************************
+ */
+void lunch_trace_dump(void);
+
+#else
+
+#define LUNCH_TRACE(type, a, b) do {} while (0)
+
+static inline void lunch_trace_init(void) {}
+static inline void lunch_trace_dump(void) {}
+
+#endif
+
+// PM locks go through here so they show up in the trace
+#define LUNCH_PM_LOCK(id) do { \
+    atm_pm_lock(id); \
+    LUNCH_TRACE(TR_PM_LOCK, id, 0); \
+} while (0)
+
+#define LUNCH_PM_UNLOCK(id) do { \
+    atm_pm_unlock(id); \
+    LUNCH_TRACE(TR_PM_UNLOCK, id, 0); \
+} while (0)
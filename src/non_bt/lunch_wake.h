@@ -0,0 +1,25 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_wake.h
+ *
+ * @brief Placement of the wake path
+ *
+ * Everything from boot to the first lunch adv packet is marked __WAKE_PATH.
+ * With CFG_LUNCH_FAST_WAKE those functions are linked into RAM like __FAST,
+ * so a cold start from hibernation does not wait on flash. Compare both
+ * builds with tools/wake_report.py.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+#pragma once
+
+#include "arch.h"
+
+#ifdef CFG_LUNCH_FAST_WAKE
+#define __WAKE_PATH __FAST
+#else
+#define __WAKE_PATH
+#endif
@@ -0,0 +1,73 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_wurx.c
+ *
+ * @brief WuRX events while awake or in retention
+ *
+ * In hibernation a WuRX hit reboots the chip. While awake or retained it only
+ * raises an interrupt, which we hand off to the main loop here.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include "arch.h"
+#include "atm_log.h"
+#include "interrupt.h"
+#include "sw_event.h"
+#include "wurx.h"
+
+#include "lunch_wurx.h"
+#include "lunch_log.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_wurx", V);
+
+static lunch_wurx_cb event_cb;
+static sw_event_id_t wurx_event_id;
+static bool armed;
+
+static void wurx_event(sw_event_id_t event_id, const void *ctx)
+{
+    sw_event_clear(wurx_event_id);
+
+    // One shot, the owner re-arms when it wants the next one
+    if (!armed) {
+        return;
+    }
+    armed = false;
+
+    LUNCH_LOG(D, LL_WURX_EVENT, "WuRX event");
+    event_cb();
+}
+
+__FAST static void wurx_irq_hdlr(void)
+{
+    NVIC_DisableIRQ(WURX_IRQn);
+    wurx_disable();
+    sw_event_set(wurx_event_id);
+}
+
+void lunch_wurx_init(lunch_wurx_cb cb)
+{
+    event_cb = cb;
+    wurx_event_id = sw_event_alloc(wurx_event, NULL);
+    interrupt_install(WURX_IRQn, wurx_irq_hdlr);
+}
+
+void lunch_wurx_arm(void)
+{
+    armed = true;
+    NVIC_ClearPendingIRQ(WURX_IRQn);
+    NVIC_EnableIRQ(WURX_IRQn);
+    wurx_enable();
+}
+
+void lunch_wurx_disarm(void)
+{
+    armed = false;
+    NVIC_DisableIRQ(WURX_IRQn);
+    wurx_disable();
+}
@@ -0,0 +1,39 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_wurx.h
+ *
+ * @brief WuRX events while awake or in retention
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+typedef void (*lunch_wurx_cb)(void);
+
+/**
+ *******************************************************************************
+ * @brief Initialize WuRX event handling
+ *
+ * @param[in] cb  Called from the main loop when the WuRX pattern is detected
+ *******************************************************************************
+ */
+void lunch_wurx_init(lunch_wurx_cb cb);
+
+/**
+ *******************************************************************************
+ * @brief Listen for the next WuRX event while awake or in retention
+ * @note One shot. Hibernation has its own path through the prevent hibernation vector
+ *******************************************************************************
+ */
+void lunch_wurx_arm(void);
+
+/**
+ *******************************************************************************
+ * @brief Stop listening for WuRX
+ *******************************************************************************
+ */
+void lunch_wurx_disarm(void);
@@ -0,0 +1,257 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_wurx_tune.c
+ *
+ * @brief Self tuning WuRX sensitivity
+ *
+ * A wake is confirmed by any contact with the gate: another WuRX hit while
+ * we are awake or warm, or the gate waking us again from hibernation within
+ * CFG_WURX_TUNE_CONFIRM_S. Wakes without any are counted as false. When too
+ * many are false the PMU_WURX threshold is raised, then the duty cycle
+ * lowered, one step at a time. A lunch window that passes without a single
+ * confirmed wake steps back toward the values that were flashed, and so
+ * does a day without one when there is no schedule.
+ *
+ * Where the threshold and duty cycle sit in PMU_WURX is not known here. The
+ * level is only written back when the board defines CFG_WURX_TUNE_THRESH_OFS
+ * and CFG_WURX_TUNE_DUTY_OFS from the SDK, otherwise it is only logged. The
+ * WuRX driver reads PMU_WURX from nvds when it starts, so a new level takes
+ * effect on the next boot.
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "arch.h"
+#include "nvds.h"
+#include "timer.h"
+#include "atm_log.h"
+
+#include "cfg_lunch_params.h"
+#include "lunch_wurx_tune.h"
+#include "lunch_nvds.h"
+#include "lunch_log.h"
+
+ATM_LOG_LOCAL_SETTING("lunch_wurx_tune", V);
+
+#define MAX_LEVEL (CFG_WURX_TUNE_THRESH_MAX_STEPS + CFG_WURX_TUNE_DUTY_MAX_STEPS)
+
+#if defined(CFG_WURX_TUNE_THRESH_OFS) && defined(CFG_WURX_TUNE_DUTY_OFS)
+#define TUNE_PMU_WURX 1
+#else
+#define TUNE_PMU_WURX 0
+#endif
+
+/*
+ * VARIABLES
+ *******************************************************************************
+ */
+
+static nvds_wurx_tune_t tune;
+static bool loaded;
+static bool wake_open;
+static bool wake_confirmed;
+
+/*
+ * STATIC FUNCTIONS
+ *******************************************************************************
+ */
+
+static bool load(void)
+{
+    if (loaded) {
+        return true;
+    }
+
+    if (nvds_get_wurx_tune(&tune) != NVDS_OK) {
+        memset(&tune, 0, sizeof(tune));
+#if TUNE_PMU_WURX
+        // First run, remember what was flashed as the defaults
+        uint8_t pmu[PMU_WURX_MAX_LEN];
+        nvds_tag_len_t len = sizeof(pmu);
+        if (nvds_get_pmu_wurx(pmu, &len) != NVDS_OK ||
+            len <= CFG_WURX_TUNE_THRESH_OFS || len <= CFG_WURX_TUNE_DUTY_OFS) {
+            ATM_LOG(E, "%s: no PMU_WURX to tune", __func__);
+            return false;
+        }
+
+        tune.def_thresh = pmu[CFG_WURX_TUNE_THRESH_OFS];
+        tune.def_duty = pmu[CFG_WURX_TUNE_DUTY_OFS];
+#endif
+    }
+
+    loaded = true;
+    return true;
+}
+
+#if TUNE_PMU_WURX
+static uint8_t clamp_u8(int32_t v)
+{
+    return v < 0 ? 0 : (v > 0xFF ? 0xFF : v);
+}
+#endif
+
+// Read-modify-write so the rest of PMU_WURX stays as flashed
+static void apply_level(void)
+{
+#if TUNE_PMU_WURX
+    uint8_t pmu[PMU_WURX_MAX_LEN];
+    nvds_tag_len_t len = sizeof(pmu);
+    if (nvds_get_pmu_wurx(pmu, &len) != NVDS_OK) {
+        return;
+    }
+
+    // Threshold first, duty only once the threshold is at its limit
+    uint8_t thresh_steps = tune.level < CFG_WURX_TUNE_THRESH_MAX_STEPS ?
+        tune.level : CFG_WURX_TUNE_THRESH_MAX_STEPS;
+    uint8_t duty_steps = tune.level - thresh_steps;
+
+    pmu[CFG_WURX_TUNE_THRESH_OFS] = clamp_u8(tune.def_thresh + thresh_steps * CFG_WURX_TUNE_THRESH_STEP);
+    pmu[CFG_WURX_TUNE_DUTY_OFS] = clamp_u8(tune.def_duty - duty_steps * CFG_WURX_TUNE_DUTY_STEP);
+
+    nvds_put_pmu_wurx(pmu, len);
+
+    LUNCH_LOG(D, LL_WURX_TUNE_LEVEL, "WuRX tune level %d: thresh=%d duty=%d",
+        tune.level, pmu[CFG_WURX_TUNE_THRESH_OFS], pmu[CFG_WURX_TUNE_DUTY_OFS]);
+#else
+    LUNCH_LOG(D, LL_WURX_TUNE_ADVISE, "WuRX tune level %d, PMU_WURX layout unknown, not written",
+        tune.level);
+#endif
+}
+
+static void step_back(void)
+{
+    tune.level--;
+    tune.eval_wakes = 0;
+    tune.eval_false = 0;
+    apply_level();
+}
+
+static void evaluate(void)
+{
+    if (tune.eval_wakes < CFG_WURX_TUNE_EVAL_WAKES) {
+        return;
+    }
+
+    uint32_t false_pct = (uint32_t) tune.eval_false * 100 / tune.eval_wakes;
+    tune.eval_wakes = 0;
+    tune.eval_false = 0;
+
+    if (false_pct > CFG_WURX_TUNE_FALSE_PCT && tune.level < MAX_LEVEL) {
+        tune.level++;
+        apply_level();
+    }
+}
+
+/*
+ * GLOBAL FUNCTIONS
+ *******************************************************************************
+ */
+
+void lunch_wurx_tune_wake(void)
+{
+    if (!load()) {
+        return;
+    }
+
+    // Heard the gate again soon after, the last one was real. Untuned there
+    // is no timer wake to drop it, a gap past the sys time wrap may confirm
+    // a false one, which only errs toward sensitive
+    if (tune.last_false &&
+        atm_get_sys_time() - tune.false_time < CFG_WURX_TUNE_CONFIRM_S * 1000000UL) {
+        tune.unconfirmed--;
+        tune.confirmed++;
+        if (tune.eval_false) {
+            tune.eval_false--;
+        }
+        tune.window_hit = true;
+        tune.quiet_s = 0;
+    }
+    tune.last_false = false;
+
+    wake_open = true;
+    wake_confirmed = false;
+}
+
+void lunch_wurx_tune_contact(void)
+{
+    if (!wake_open || wake_confirmed) {
+        return;
+    }
+
+    wake_confirmed = true;
+    tune.window_hit = true;
+    tune.quiet_s = 0;
+    LUNCH_LOG(D, LL_WURX_TUNE_CONTACT, "WuRX wake confirmed");
+}
+
+void lunch_wurx_tune_sleep(void)
+{
+    if (!wake_open) {
+        return;
+    }
+    wake_open = false;
+
+    tune.eval_wakes++;
+    if (wake_confirmed) {
+        tune.confirmed++;
+    } else {
+        tune.unconfirmed++;
+        tune.eval_false++;
+        tune.last_false = true;
+        tune.false_time = atm_get_sys_time();
+    }
+
+    LUNCH_LOG(D, LL_WURX_TUNE_SLEEP, "WuRX wakes confirmed=%lu false=%lu",
+        tune.confirmed, tune.unconfirmed);
+
+    evaluate();
+    nvds_put_wurx_tune(&tune);
+}
+
+void lunch_wurx_tune_window_end(void)
+{
+    if (!load()) {
+        return;
+    }
+
+    tune.last_false = false;
+
+    if (!tune.window_hit && tune.level) {
+        LUNCH_LOG(D, LL_WURX_TUNE_MISS, "No confirmed wake this lunch window");
+        step_back();
+    }
+
+    tune.window_hit = false;
+    nvds_put_wurx_tune(&tune);
+}
+
+uint32_t lunch_wurx_tune_timer_s(void)
+{
+    return TUNE_PMU_WURX && load() && tune.level ? CFG_WURX_TUNE_TIMER_S : 0;
+}
+
+void lunch_wurx_tune_timer_wake(void)
+{
+    // No timer of our own without a PMU_WURX to write, nothing to step back
+    if (!TUNE_PMU_WURX || !load() || !tune.level) {
+        return;
+    }
+
+    // Drop a false wake before the sys time can wrap past it
+    if (atm_get_sys_time() - tune.false_time >= CFG_WURX_TUNE_CONFIRM_S * 1000000UL) {
+        tune.last_false = false;
+    }
+
+    tune.quiet_s += CFG_WURX_TUNE_TIMER_S;
+    if (tune.quiet_s >= CFG_WURX_TUNE_QUIET_S) {
+        LUNCH_LOG(D, LL_WURX_TUNE_QUIET, "No confirmed wake for %lus", tune.quiet_s);
+        tune.quiet_s = 0;
+        step_back();
+    }
+    nvds_put_wurx_tune(&tune);
+}
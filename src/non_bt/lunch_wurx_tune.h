@@ -0,0 +1,98 @@
+/**
+ *******************************************************************************
+ *
+ * @file lunch_wurx_tune.h
+ *
+ * @brief Self tuning WuRX sensitivity
+ *
+ * Copyright (C) LunchTrak 2023
+ *
+ *******************************************************************************
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include "arch.h"
+
+/**
+ * @brief NVDS WuRX tuning record
+ * @note def_* are the PMU_WURX values as flashed, level is how many steps
+ * away from them we are
+ */
+typedef struct {
+    uint8_t def_thresh;
+    uint8_t def_duty;
+    uint8_t level;
+    uint8_t window_hit; // a confirmed wake in the current lunch window
+    uint16_t eval_wakes;
+    uint16_t eval_false;
+    uint32_t confirmed;
+    uint32_t unconfirmed;
+    uint32_t quiet_s;    // timer wakes without a real wake, no schedule
+    uint32_t false_time; // sys time the last false wake closed at
+    uint8_t last_false;  // it may still be confirmed until CFG_WURX_TUNE_CONFIRM_S
+} __PACKED nvds_wurx_tune_t;
+
+#ifdef CFG_LUNCH_WURX_TUNE
+
+/**
+ *******************************************************************************
+ * @brief A WuRX wake started
+ * @note Call on a WuRX boot and on a WuRX wake from retention. A wake closed
+ * as false less than CFG_WURX_TUNE_CONFIRM_S ago was the gate after all
+ *******************************************************************************
+ */
+void lunch_wurx_tune_wake(void);
+
+/**
+ *******************************************************************************
+ * @brief The gate was there, this wake is a real one
+ *******************************************************************************
+ */
+void lunch_wurx_tune_contact(void);
+
+/**
+ *******************************************************************************
+ * @brief Close the current wake and retune if enough wakes were seen
+ * @note Call when going to sleep, warm or not
+ *******************************************************************************
+ */
+void lunch_wurx_tune_sleep(void);
+
+/**
+ *******************************************************************************
+ * @brief A lunch window from the schedule is over
+ * @note No confirmed wake during it means we may be too deaf now
+ *******************************************************************************
+ */
+void lunch_wurx_tune_window_end(void);
+
+/**
+ *******************************************************************************
+ * @brief Hibernation timer the tuning needs when there is no schedule
+ * @note Only a tag that wrote a tuned level to PMU_WURX asks for one
+ * @returns seconds, 0 for none
+ *******************************************************************************
+ */
+uint32_t lunch_wurx_tune_timer_s(void);
+
+/**
+ *******************************************************************************
+ * @brief The timer from lunch_wurx_tune_timer_s() woke us
+ * @note After CFG_WURX_TUNE_QUIET_S of these without a real wake we may be
+ * too deaf now
+ *******************************************************************************
+ */
+void lunch_wurx_tune_timer_wake(void);
+
+#else
+
+static inline void lunch_wurx_tune_wake(void) {}
+static inline void lunch_wurx_tune_contact(void) {}
+static inline void lunch_wurx_tune_sleep(void) {}
+static inline void lunch_wurx_tune_window_end(void) {}
+static inline uint32_t lunch_wurx_tune_timer_s(void) { return 0; }
+static inline void lunch_wurx_tune_timer_wake(void) {}
+
+#endif // CFG_LUNCH_WURX_TUNE
@@ -0,0 +1,63 @@
+import argparse
+import struct
+
+# Must match nvds_energy_t in src/non_bt/lunch_energy.h
+PHASES = ['boot', 'gap_init', 'adv', 'connected', 'retain', 'hib']
+ENERGY_FMT = '<' + 'I' * len(PHASES) + 'IIIHH'
+
+# Must match CFG_ENERGY_VBAT_STEP_MV in src/cfg_lunch_params.h
+VBAT_STEP_MV = 20
+
+UC_PER_MAH = 3600 * 1000
+
+
+def parse_energy(hex_str):
+    fields = struct.unpack(ENERGY_FMT, bytes.fromhex(hex_str.replace(' ', '')))
+    n = len(PHASES)
+    return {
+        'charge_uc': dict(zip(PHASES, fields[:n])),
+        'adv_events': fields[n],
+        'wakes': fields[n + 1],
+        'hib_s': fields[n + 2],
+        'vbat_mv': fields[n + 3],
+        'vbat_min_mv': fields[n + 4],
+    }
+
+
+def report(e, capacity_mah, days):
+    total_uc = sum(e['charge_uc'].values())
+    used_mah = total_uc / UC_PER_MAH
+
+    print(f"Battery: {e['vbat_mv']} mV (lowest {e['vbat_min_mv']} mV)")
+    print(f"Wakes: {e['wakes']}, adv events: {e['adv_events']}, hibernated {e['hib_s'] / 86400:.1f} days")
+    print('Charge per phase:')
+    for phase, uc in sorted(e['charge_uc'].items(), key=lambda kv: -kv[1]):
+        pct = 100 * uc / total_uc if total_uc else 0
+        print(f'  {phase:<10} {uc / UC_PER_MAH:9.3f} mAh  {pct:5.1f}%')
+    print(f'Total used: {used_mah:.3f} mAh of {capacity_mah} mAh')
+
+    if e['wakes']:
+        print(f"Per wake: {total_uc / e['wakes'] / 1000:.1f} mC")
+
+    if days:
+        per_day = used_mah / days
+        left = max(capacity_mah - used_mah, 0)
+        print(f'Drain: {per_day:.3f} mAh/day')
+        if per_day > 0:
+            print(f'Projected remaining life: {left / per_day:.0f} days')
+
+
+parser = argparse.ArgumentParser(description='Project LunchTrak tag battery life')
+parser.add_argument('energy', nargs='?', help='Energy characteristic value in hex')
+parser.add_argument('--vbat-byte', type=lambda x: int(x, 0),
+                    help='Battery byte from the lunch scan response instead')
+parser.add_argument('--capacity', type=float, default=225, help='Battery capacity in mAh (CR2032 = 225)')
+parser.add_argument('--days', type=float, help='Days since the battery was installed')
+args = parser.parse_args()
+
+if args.vbat_byte is not None:
+    print(f'Battery: ~{args.vbat_byte * VBAT_STEP_MV} mV')
+elif args.energy:
+    report(parse_energy(args.energy), args.capacity, args.days)
+else:
+    parser.error('need an energy record or --vbat-byte')
@@ -0,0 +1,335 @@
+import argparse
+import json
+import os
+import re
+
+# Estimates airtime, average current and battery life of a beacon
+# configuration from its tds files, without a bench run. A configuration is
+# either a reference_beacon_* target from reference_beacons.mk or the live
+# flash_nvds.data list in the makefile (adv params then come from
+# src/cfg_adv_params.h, like the app does). Currents come from
+# tools/current_model.json.
+#
+# The makefile list is read the way make would: variables take the
+# makefile's defaults, and ifeq/ifneq blocks are followed. Override them
+# like on the make command line, "makefile:BEACON_ONLY=1,LUNCH_DATA=x".
+# BOOT_US is not a make variable: it is the measured boot to lunch adv on
+# time of that build from tools/wake_report.py, and replaces the model's
+# boot and GAP init time.
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+DAY_S = 86400
+UC_PER_MAH = 3600 * 1000
+
+# GAPM_ADV_PROP bits
+PROP_CONN, PROP_SCAN = 0x01, 0x02
+ADV_TYPES = ['legacy', 'extended', 'periodic']
+PHYS = {1: '1M', 2: '2M', 3: 'LR125'}
+
+
+def expand(text, variables):
+    return re.sub(r'\$\((\w+)\)', lambda m: variables.get(m.group(1), ''), text)
+
+
+def read_vars(path):
+    # Plain "NAME=value" defaults at the top level of a makefile
+    variables = {}
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'^([A-Z_][A-Z0-9_]*)\s*:?=\s*(.*?)\s*$', line)
+            if m:
+                variables[m.group(1)] = m.group(2).strip('"')
+    return variables
+
+
+def read_list(path, var, variables=None):
+    # Items of a "var := \" or "var += \" make list. With variables, the
+    # items are expanded and only lists in taken ifeq/ifneq branches count
+    items = []
+    with open(path) as f:
+        lines = f.read().splitlines()
+    taken = []
+    i = 0
+    while i < len(lines):
+        line = lines[i].strip()
+        i += 1
+        if variables is not None:
+            cond = re.match(r'^if(n?)eq\s*\((.*),(.*)\)$', line)
+            if cond:
+                equal = expand(cond.group(2), variables).strip() == expand(cond.group(3), variables).strip()
+                taken.append(equal != bool(cond.group(1)))
+                continue
+            if line == 'else' and taken:
+                taken[-1] = not taken[-1]
+                continue
+            if line == 'endif' and taken:
+                taken.pop()
+                continue
+        m = re.match(rf'^{re.escape(var)}\s*[:+]?=\s*\\?$', line)
+        if not m:
+            continue
+        use = all(taken)
+        while i < len(lines) and lines[i].strip():
+            item = lines[i].strip().rstrip('\\').strip()
+            if variables is not None:
+                item = expand(item, variables)
+            if use and item and not item.startswith('$(') and not item.startswith('#'):
+                items.append(item)
+            if not lines[i].rstrip().endswith('\\'):
+                break
+            i += 1
+    return items
+
+
+def read_tds(item):
+    with open(os.path.join(ROOT, 'tag_data', item + '.tds')) as f:
+        text = f.read()
+    data = []
+    for line in text.splitlines():
+        data += [int(b, 16) for b in line.split('#')[0].split()]
+    return bytes(data)
+
+
+def u16(b, ofs):
+    return b[ofs] | b[ofs + 1] << 8
+
+
+def u32(b, ofs):
+    return u16(b, ofs) | u16(b, ofs + 2) << 16
+
+
+def parse_crt(b, lr500):
+    # atm_adv_create_t as laid out in tag_data/06-APP_BLE_ACT_CRT_CMD
+    sec_phy = PHYS.get(b[32], PHYS[b[28]])
+    if sec_phy == 'LR125' and lr500:
+        sec_phy = 'LR500'
+    return {
+        'type': ADV_TYPES[b[3]],
+        'prop': u16(b, 5),
+        'intv_ms': u32(b, 19) * 0.625,
+        'ch': bin(b[27]).count('1') or 3,
+        'phy': PHYS[b[28]],
+        'sec_phy': sec_phy,
+        'per_intv_ms': u16(b, 33) * 1.25 if len(b) > 34 else 0,
+    }
+
+
+def parse_strt(b):
+    return {'duration_ms': u16(b, 0) * 10, 'max_evt': b[2]}
+
+
+def read_macro(path, name):
+    with open(path) as f:
+        text = f.read()
+    m = re.search(rf'^#define {name}\b(.*?)(?<!\\)$', text, re.M | re.S)
+    if not m:
+        return None
+    body = re.sub(r'/\*.*?\*/|//[^\n]*|\\\n', ' ', m.group(1))
+    return body.strip()
+
+
+def payload_len(path, name):
+    body = read_macro(path, name)
+    return len([x for x in body.split(',') if x.strip()]) if body else 0
+
+
+def app_adv():
+    # The lunch app sets ADV0 from cfg_adv_params.h, not from tds files
+    path = os.path.join(ROOT, 'src', 'cfg_adv_params.h')
+    prop_name = read_macro(path, 'CFG_ADV0_CREATE_PROPERTY')
+    prop = 0 if 'NON_CONN' in prop_name else PROP_CONN
+    if 'SCAN' in prop_name.replace('NON_SCAN', ''):
+        prop |= PROP_SCAN
+    adv = {
+        'type': 'legacy', 'prop': prop,
+        'intv_ms': float(read_macro(path, 'ADV0_INTERVAL')),
+        'ch': 3, 'phy': '1M', 'sec_phy': '1M', 'per_intv_ms': 0,
+        'adv_len': payload_len(path, 'CFG_ADV0_DATA_ADV_PAYLOAD'),
+    }
+    start = {'duration_ms': int(read_macro(path, 'CFG_ADV0_START_DURATION')) * 10, 'max_evt': 0}
+
+    warm = read_macro(os.path.join(ROOT, 'src', 'cfg_lunch_params.h'), 'CFG_LUNCH_WARM_WINDOW')
+    return adv, start, int(warm) * 10 if warm else 0
+
+
+def load_config(name):
+    base, _, sets = name.partition(':')
+    variables = read_vars(os.path.join(ROOT, 'makefile'))
+    for s in filter(None, sets.split(',')):
+        key, eq, value = s.partition('=')
+        if not eq:
+            raise SystemExit(f'{name}: expected VAR=value, got {s}')
+        variables[key.strip()] = value.strip()
+    boot_us = variables.pop('BOOT_US', None)
+
+    if base == 'makefile':
+        items = read_list(os.path.join(ROOT, 'makefile'), 'flash_nvds.data', variables)
+    elif sets:
+        raise SystemExit(f'{name}: only the makefile takes make variables')
+    else:
+        items = read_list(os.path.join(ROOT, 'reference_beacons.mk'), f'reference_beacon_{name}')
+        if not items:
+            raise SystemExit(f'No reference_beacon_{name} in reference_beacons.mk')
+
+    try:
+        tags = {item.split('-')[0].lower(): read_tds(item) for item in items}
+    except FileNotFoundError as e:
+        raise SystemExit(f'{name}: no {os.path.relpath(e.filename)}')
+    lr500 = '85' in tags and tags['85'][0] == 1
+    cfg = {'name': name, 'sleep_mode': tags['11'][0] if '11' in tags else 0,
+           'restart_ms': u32(tags['09'], 0) * 10 if '09' in tags else 0,
+           'wurx': 'b4' in tags, 'warm_ms': 0, 'wurx_adv': None,
+           'boot_us': float(boot_us) if boot_us else None}
+
+    if '06' in tags:
+        cfg['adv'] = parse_crt(tags['06'], lr500)
+        cfg['adv']['adv_len'] = len(tags.get('0b', b''))
+        cfg['start'] = parse_strt(tags['05']) if '05' in tags else {'duration_ms': 0, 'max_evt': 0}
+    elif base == 'makefile':
+        cfg['adv'], cfg['start'], cfg['warm_ms'] = app_adv()
+    else:
+        raise SystemExit(f'{name} has no 06-APP_BLE_ACT_CRT_CMD')
+
+    if cfg['wurx'] and '21' in tags:
+        cfg['wurx_adv'] = parse_crt(tags['21'], lr500)
+        cfg['wurx_adv']['adv_len'] = len(tags.get('22', b''))
+        cfg['wurx_start'] = parse_strt(tags['20']) if '20' in tags else cfg['start']
+    cfg['per_len'] = len(tags.get('0c', b''))
+    return cfg
+
+
+def event(m, adv, per_len):
+    # Charge (uC) and tx airtime (us) of one adv event
+    us_b = m['phy_us_per_byte']
+    scanned = adv['prop'] & (PROP_CONN | PROP_SCAN)
+    if adv['type'] == 'legacy':
+        tx_us = adv['ch'] * (m['pdu_overhead_bytes'] + 6 + adv['adv_len']) * us_b[adv['phy']]
+        rx_us = adv['ch'] * m['scan_listen_us'] if scanned else 0
+    else:
+        # ADV_EXT_IND on each primary channel, then one AUX_ADV_IND
+        tx_us = adv['ch'] * (m['pdu_overhead_bytes'] + m['ext_ind_bytes']) * us_b[adv['phy']]
+        tx_us += (m['pdu_overhead_bytes'] + m['aux_header_bytes'] + adv['adv_len']) * us_b[adv['sec_phy']]
+        rx_us = m['scan_listen_us'] if scanned else 0
+    rx_us += (adv['ch'] - 1) * m['channel_switch_us']
+    uc = (tx_us * m['tx_ua'] + rx_us * m['rx_ua']) / 1e6 + m['event_overhead_uc']
+
+    per_uc = 0
+    if adv['type'] == 'periodic' and adv['per_intv_ms']:
+        per_tx = (m['pdu_overhead_bytes'] + m['aux_header_bytes'] + per_len) * us_b[adv['sec_phy']]
+        per_uc = per_tx * m['tx_ua'] / 1e6 + m['event_overhead_uc']
+    return uc, tx_us, per_uc
+
+
+def burst(m, adv, start, per_len, idle_ua):
+    # One adv run: events, seconds, adv charge and idle charge (uC)
+    if start['max_evt']:
+        events = start['max_evt']
+        dur_s = events * adv['intv_ms'] / 1000
+    else:
+        dur_s = start['duration_ms'] / 1000
+        events = dur_s * 1000 / adv['intv_ms']
+    uc, tx_us, per_uc = event(m, adv, per_len)
+    adv_uc = events * uc
+    if per_uc:
+        adv_uc += dur_s * 1000 / adv['per_intv_ms'] * per_uc
+    return events, dur_s, adv_uc, dur_s * idle_ua, events * tx_us
+
+
+def estimate(cfg, m, wakes_per_day):
+    sleep_ua = m['sleep_ua'][str(cfg['sleep_mode'])]
+    # Between adv events the platform retains, it only hibernates once adv is done
+    adv_idle_ua = m['sleep_ua'][str(min(cfg['sleep_mode'], 3))]
+    wake_uc = (m['boot']['ua'] * m['boot']['us'] + m['gap_init']['ua'] * m['gap_init']['us']) / 1e6
+    if cfg['boot_us']:
+        # Measured time, at the model's mix of boot and GAP init current
+        wake_uc *= cfg['boot_us'] / (m['boot']['us'] + m['gap_init']['us'])
+    adv, start = cfg['adv'], cfg['start']
+    r = {'wake': 0, 'adv': 0, 'idle': 0, 'sleep': 0, 'events': 0, 'airtime_us': 0}
+
+    def add_burst(n, adv, start):
+        events, dur_s, adv_uc, idle_uc, air = burst(m, adv, start, cfg['per_len'], adv_idle_ua)
+        r['events'] += n * events
+        r['adv'] += n * adv_uc
+        r['idle'] += n * idle_uc
+        r['airtime_us'] += n * air
+        return n * dur_s
+
+    if not start['max_evt'] and not start['duration_ms'] and not cfg['wurx']:
+        # Advertises forever
+        add_burst(1, adv, {'duration_ms': DAY_S * 1000, 'max_evt': 0})
+        r['mode'] = 'always on'
+    elif cfg['wurx']:
+        hib_ua = m['hib_wurx_ua'] if cfg['sleep_mode'] == 4 else sleep_ua + m['hib_wurx_ua'] - m['sleep_ua']['4']
+        wadv = cfg['wurx_adv'] or adv
+        wstart = cfg.get('wurx_start', start)
+        busy_s = add_burst(wakes_per_day, wadv, wstart)
+        warm_s = wakes_per_day * cfg['warm_ms'] / 1000
+        r['wake'] = wakes_per_day * wake_uc
+        r['idle'] += warm_s * m['retain_ua']
+        r['sleep'] = (DAY_S - busy_s - warm_s) * hib_ua
+        r['mode'] = f'{wakes_per_day:g} WuRX wakes/day'
+    elif cfg['restart_ms']:
+        one = burst(m, adv, start, cfg['per_len'], adv_idle_ua)
+        cycles = DAY_S / (one[1] + cfg['restart_ms'] / 1000)
+        add_burst(cycles, adv, start)
+        r['wake'] = cycles * wake_uc if cfg['sleep_mode'] == 4 else 0
+        r['sleep'] = cycles * cfg['restart_ms'] / 1000 * sleep_ua
+        r['mode'] = f'{cycles:.0f} restarts/day'
+    else:
+        # One run after boot, then sleeps until reset
+        busy_s = add_burst(1, adv, start)
+        r['wake'] = wake_uc
+        r['sleep'] = (DAY_S - busy_s) * sleep_ua
+        r['mode'] = 'one run, then sleep'
+
+    r['total'] = r['wake'] + r['adv'] + r['idle'] + r['sleep']
+    r['avg_ua'] = r['total'] / DAY_S
+    r['life_days'] = m['battery_mah'] * UC_PER_MAH / r['total']
+    return r
+
+
+def describe(adv):
+    kind = adv['type'] + (' conn' if adv['prop'] & PROP_CONN else '') + (' scan' if adv['prop'] & PROP_SCAN else '')
+    return f"{kind} {adv['intv_ms']:g}ms {adv['ch']}ch {adv['phy']}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Estimate LunchTrak beacon energy from its tds configuration')
+    parser.add_argument('configs', nargs='*', default=['makefile'],
+                        help='"makefile" or reference_beacon_* target names (e.g. WURX power_profile). '
+                             'makefile:VAR=value,... overrides make variables, BOOT_US=us a measured boot time')
+    parser.add_argument('--wakes-per-day', type=float, default=2, help='WuRX wakes per day (lunch visits)')
+    parser.add_argument('--model', default=os.path.join(os.path.dirname(os.path.abspath(__file__)), 'current_model.json'))
+    parser.add_argument('--capacity', type=float, help='Battery capacity in mAh, overrides the model')
+    args = parser.parse_args()
+
+    with open(args.model) as f:
+        model = json.load(f)
+    if args.capacity:
+        model['battery_mah'] = args.capacity
+
+    cfgs = [load_config(c) for c in args.configs]
+    results = [estimate(c, model, args.wakes_per_day) for c in cfgs]
+
+    rows = [
+        ('adv', lambda c, r: describe(c['wurx_adv'] or c['adv']) if c['wurx'] else describe(c['adv'])),
+        ('sleep mode', lambda c, r: str(c['sleep_mode'])),
+        ('boot (us)', lambda c, r: f"{c['boot_us']:.0f}" if c['boot_us'] else 'model'),
+        ('pattern', lambda c, r: r['mode']),
+        ('adv events/day', lambda c, r: f"{r['events']:.0f}"),
+        ('airtime/day (s)', lambda c, r: f"{r['airtime_us'] / 1e6:.2f}"),
+        ('wake (uAh/day)', lambda c, r: f"{r['wake'] / 3600:.2f}"),
+        ('adv (uAh/day)', lambda c, r: f"{r['adv'] / 3600:.1f}"),
+        ('adv idle (uAh/day)', lambda c, r: f"{r['idle'] / 3600:.1f}"),
+        ('sleep (uAh/day)', lambda c, r: f"{r['sleep'] / 3600:.1f}"),
+        ('average (uA)', lambda c, r: f"{r['avg_ua']:.2f}"),
+        ('battery life (days)', lambda c, r: f"{r['life_days']:.0f}"),
+    ]
+    width = max(24, *(max(len(describe(c['adv'])), len(c['name'])) + 2 for c in cfgs))
+    print(f"{'':<20}" + ''.join(f"{c['name']:>{width}}" for c in cfgs))
+    for title, fn in rows:
+        print(f'{title:<20}' + ''.join(f'{fn(c, r):>{width}}' for c, r in zip(cfgs, results)))
+    print(f"\nModel: {os.path.basename(args.model)}, {model['battery_mah']:g} mAh")
+
+
+main()
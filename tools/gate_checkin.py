@@ -0,0 +1,219 @@
+import argparse
+import math
+import random
+import sys
+import time
+from collections import OrderedDict
+
+# Turns the lunch advs a gate hears into check-ins. Hearing a tag only means
+# it is nearby, tags at the tables next to the register leak into range at
+# CFG_ADV0_CREATE_MAX_TX_POWER. A student walking up to the register shows
+# up as RSSI rising from a trough, peaking and falling again, so every tag
+# gets a small filter: smoothed RSSI, the trough and the peak since it came
+# in range. A check-in is reported for the time of the peak once RSSI has
+# fallen DROP_DB below it, and only if it rose RISE_DB above the trough and
+# got within CHECKIN_DBM. Tags sitting still never rise and fall, so they
+# never check in.
+#
+# State is a fixed handful of numbers per tag, and tags not heard for
+# STALE_S are dropped oldest first, so thousands of tags in range cost the
+# same per adv as one.
+#
+# Input, one adv per line: time in seconds, BD address, RSSI and the adv
+# data in hex, e.g. "12.345 7c:69:6b:00:00:c9 -63 0303f52a132af52a...".
+# Output: CHECKIN <peak time> <address> <school ID> <student ID> <peak dBm>
+
+# Service data of the lunch adv, see CFG_ADV0_DATA_ADV_PAYLOAD in
+# src/cfg_adv_params.h: f5 2a, then 6 bytes school ID and 10 bytes student ID
+# (or a 16 byte token with TOKENS=1)
+LUNCH_AD_TYPES = (0x16, 0x2a)
+LUNCH_UUID = bytes([0xf5, 0x2a])
+SCHOOL_ID_LEN, STUDENT_ID_LEN = 6, 10
+
+FAR, NEAR, DONE = range(3)
+
+
+def parse_lunch_adv(data):
+    # Walk the AD structures for the lunch service data
+    i = 0
+    while i + 1 < len(data):
+        ad_len = data[i]
+        if not ad_len:
+            break
+        ad_type, body = data[i + 1], data[i + 2:i + 1 + ad_len]
+        if ad_type in LUNCH_AD_TYPES and body[:2] == LUNCH_UUID and \
+                len(body) >= 2 + SCHOOL_ID_LEN + STUDENT_ID_LEN:
+            school = body[2:2 + SCHOOL_ID_LEN]
+            student = body[2 + SCHOOL_ID_LEN:2 + SCHOOL_ID_LEN + STUDENT_ID_LEN]
+            return id_str(school), id_str(student)
+        i += 1 + ad_len
+    return None
+
+
+def id_str(raw):
+    # Cleartext IDs are 0 padded ascii, anything else is a token
+    text = raw.rstrip(b'\0')
+    if text and all(0x20 < b < 0x7f for b in text):
+        return text.decode()
+    return raw.hex()
+
+
+class TagTrack:
+    __slots__ = ('rssi', 'last', 'trough', 'peak', 'peak_t', 'state')
+
+    def __init__(self, t, rssi):
+        self.rssi = rssi
+        self.last = t
+        self.trough = rssi
+        self.peak = rssi
+        self.peak_t = t
+        self.state = FAR
+
+
+class CheckinDetector:
+    def __init__(self, tau_s=1.0, checkin_dbm=-60, rise_db=8, drop_db=6, rearm_db=10, stale_s=30):
+        self.tau_s = tau_s
+        self.checkin_dbm = checkin_dbm
+        self.rise_db = rise_db
+        self.drop_db = drop_db
+        self.rearm_db = rearm_db
+        self.stale_s = stale_s
+        # Least recently heard first
+        self.tags = OrderedDict()
+
+    def expire(self, now):
+        while self.tags:
+            key, tr = next(iter(self.tags.items()))
+            if now - tr.last < self.stale_s:
+                break
+            del self.tags[key]
+
+    def adv(self, t, key, rssi):
+        """Feed one adv, returns (peak time, peak dBm) on a check-in."""
+        tr = self.tags.get(key)
+        if tr is None:
+            self.tags[key] = TagTrack(t, rssi)
+            return None
+        self.tags.move_to_end(key)
+
+        # Time aware EWMA, advs don't arrive evenly
+        alpha = 1 - math.exp(-max(t - tr.last, 0) / self.tau_s)
+        tr.rssi += alpha * (rssi - tr.rssi)
+        tr.last = t
+        s = tr.rssi
+
+        if tr.state == DONE:
+            # Walked away from the register, the next approach counts again
+            if s < tr.peak - self.rearm_db:
+                tr.state, tr.trough, tr.peak, tr.peak_t = FAR, s, s, t
+            return None
+
+        if s < tr.trough and tr.state == FAR:
+            tr.trough = s
+        if s > tr.peak:
+            tr.peak, tr.peak_t = s, t
+        if tr.state == FAR and tr.peak - tr.trough >= self.rise_db and tr.peak >= self.checkin_dbm:
+            tr.state = NEAR
+        if tr.state == FAR and s < tr.peak - self.drop_db:
+            # A bump that never got close, start over from here
+            tr.trough, tr.peak, tr.peak_t = s, s, t
+        elif tr.state == NEAR and s < tr.peak - self.drop_db:
+            tr.state = DONE
+            return tr.peak_t, tr.peak
+        return None
+
+
+def parse_line(line):
+    parts = line.split()
+    if len(parts) < 4:
+        return None
+    try:
+        t, rssi, data = float(parts[0]), int(parts[2]), bytes.fromhex(parts[3])
+    except ValueError:
+        return None
+    ids = parse_lunch_adv(data)
+    if not ids:
+        return None
+    return t, parts[1].lower(), rssi, ids
+
+
+def run(det, args):
+    files = [open(p) for p in args.input] if args.input else [sys.stdin]
+    for f in files:
+        for line in f:
+            adv = parse_line(line)
+            if not adv:
+                continue
+            t, addr, rssi, ids = adv
+            det.expire(t)
+            hit = det.adv(t, (addr, ids), rssi)
+            if hit:
+                peak_t, peak = hit
+                print(f'CHECKIN {peak_t:.3f} {addr} {ids[0]} {ids[1]} {peak:.1f}', flush=True)
+                if args.latency:
+                    print(f'  {t - peak_t:.2f}s after the peak, {len(det.tags)} tags tracked', file=sys.stderr)
+    return 0
+
+
+def bench(det, args):
+    # Thousands of tags in range, a few walking past the register, the rest
+    # sitting at the tables. Times the filter alone, no parsing
+    rnd = random.Random(1)
+    keys = [(f'7c:69:6b:{i >> 16 & 0xff:02x}:{i >> 8 & 0xff:02x}:{i & 0xff:02x}', ('GUNN', str(i)))
+            for i in range(args.tags)]
+    walkers = set(rnd.sample(range(args.tags), min(args.walkers, args.tags)))
+    intv = 0.1
+    advs = checkins = false = 0
+    start = time.perf_counter()
+    t = 0.0
+    while t < args.seconds:
+        for i, key in enumerate(keys):
+            if i in walkers:
+                # Pass the register at mid run, 1m at -55dBm, path loss ~ 20log(d)
+                d = 1 + abs(t - args.seconds / 2) * 0.8
+                level = -55 - 20 * math.log10(d)
+            else:
+                level = -75 - (i % 10)
+            hit = det.adv(t + rnd.uniform(0, intv), key, round(level + rnd.gauss(0, 3)))
+            advs += 1
+            if hit:
+                checkins += 1
+                false += i not in walkers
+        det.expire(t)
+        t += intv
+    secs = time.perf_counter() - start
+    print(f'{args.tags} tags, {advs} advs in {secs:.2f}s: {advs / secs:.0f} advs/s '
+          f'({advs / args.seconds:.0f} advs/s needed)')
+    print(f'{checkins} check-ins for {len(walkers)} walkers, {false} from tags that stayed put')
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Detect LunchTrak check-ins from gate RSSI')
+    parser.add_argument('--tau', type=float, default=1.0, help='RSSI smoothing time constant (s)')
+    parser.add_argument('--checkin-dbm', type=float, default=-60, help='Peak must reach this (dBm)')
+    parser.add_argument('--rise', type=float, default=8, help='Peak must be this far above the trough (dB)')
+    parser.add_argument('--drop', type=float, default=6, help='Check in once RSSI falls this far below the peak (dB)')
+    parser.add_argument('--rearm', type=float, default=10,
+                        help='Count a new approach once RSSI is this far below the last peak (dB)')
+    parser.add_argument('--stale', type=float, default=30, help='Forget tags not heard for this long (s)')
+    sub = parser.add_subparsers(required=True)
+
+    p = sub.add_parser('run', help='Read advs from files or stdin and print check-ins')
+    p.add_argument('input', nargs='*')
+    p.add_argument('--latency', action='store_true', help='Print the delay after each peak to stderr')
+    p.set_defaults(func=run)
+
+    p = sub.add_parser('bench', help='Time the filter on synthetic tags')
+    p.add_argument('--tags', type=int, default=3000)
+    p.add_argument('--walkers', type=int, default=50)
+    p.add_argument('--seconds', type=float, default=20)
+    p.set_defaults(func=bench)
+
+    args = parser.parse_args()
+    det = CheckinDetector(args.tau, args.checkin_dbm, args.rise, args.drop, args.rearm, args.stale)
+    sys.exit(args.func(det, args))
+
+
+if __name__ == '__main__':
+    main()
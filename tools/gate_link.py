@@ -0,0 +1,227 @@
+import argparse
+import bisect
+import statistics
+import sys
+from collections import defaultdict
+
+from gate_checkin import parse_lunch_adv
+
+# Link quality at the gate from what the tags put in the lunch scan response:
+# the tag's wake count, the start delay and warm restarts of this wake, and
+# the adv interval. Each (wake count, warm restarts) is one run of the lunch
+# adv, so the gate knows how many advs a run sent between the first and last
+# one it heard, and a missing tag is told apart from lost packets.
+#
+# For every run it reports the share of advs heard, and with --pulses the
+# time from the WuRX pulse to the first adv decoded, next to the tag's own
+# start delay. Runs are then grouped by adv interval, by how many other tags
+# were advertising at the same time and by RSSI, which is where TX power and
+# distance show up.
+#
+# Input is what tools/gate_checkin.py reads, one packet per line: time in
+# seconds, BD address, RSSI and adv or scan response data in hex. Pulses are
+# one time per line, or the PULSE lines of tools/gate_pulse.py.
+
+# Scan response, see CFG_ADV0_DATA_SCANRSP_PAYLOAD in src/cfg_adv_params.h:
+# manufacturer data 00 60 'LUNCHB', vbat, wake count (le16), phase, interval
+SCANRSP_PREFIX = bytes([0x00, 0x60]) + b'LUNCHB'
+SCANRSP_FIELDS = 5
+# Controller adv delay is 0-10ms on top of the interval
+ADV_DELAY_MS = 5
+START_DELAY_MS = 10
+
+
+def parse_scanrsp(data):
+    # Walk the AD structures for the LUNCHB manufacturer data
+    i = 0
+    while i + 1 < len(data):
+        ad_len = data[i]
+        if not ad_len:
+            break
+        ad_type, body = data[i + 1], data[i + 2:i + 1 + ad_len]
+        if ad_type == 0xff and body[:len(SCANRSP_PREFIX)] == SCANRSP_PREFIX and \
+                len(body) >= len(SCANRSP_PREFIX) + SCANRSP_FIELDS:
+            f = body[len(SCANRSP_PREFIX):]
+            return {
+                'vbat': f[0],
+                'wake': f[1] | f[2] << 8,
+                'delay_ms': (f[3] & 0xf) * START_DELAY_MS,
+                'warm': f[3] >> 4,
+                'intv_ms': f[4],
+            }
+        i += 1 + ad_len
+    return None
+
+
+class Run:
+    __slots__ = ('addr', 'ids', 'wake', 'warm', 'delay_ms', 'intv_ms', 'first', 'last', 'advs', 'rssi')
+
+    def __init__(self, addr, t):
+        self.addr = addr
+        self.ids = None
+        self.wake = None
+        self.warm = None
+        self.delay_ms = None
+        self.intv_ms = None
+        self.first = t
+        self.last = t
+        self.advs = 0
+        self.rssi = []
+
+    def expected(self):
+        if not self.intv_ms:
+            return None
+        return round((self.last - self.first) * 1000 / (self.intv_ms + ADV_DELAY_MS)) + 1
+
+    def ratio(self):
+        n = self.expected()
+        return min(self.advs / n, 1.0) if n else None
+
+
+def read_runs(files, gap_s):
+    # A run ends when its tag goes quiet for gap_s or its scan response
+    # names a different wake
+    runs = []
+    cur = {}
+    for f in files:
+        for line in f:
+            parts = line.split()
+            if len(parts) < 4:
+                continue
+            try:
+                t, rssi, data = float(parts[0]), int(parts[2]), bytes.fromhex(parts[3])
+            except ValueError:
+                continue
+            addr = parts[1].lower()
+            ids = parse_lunch_adv(data)
+            rsp = parse_scanrsp(data)
+            if not ids and not rsp:
+                continue
+
+            run = cur.get(addr)
+            if run and (t - run.last > gap_s or
+                        (rsp and run.wake is not None and (rsp['wake'], rsp['warm']) != (run.wake, run.warm))):
+                runs.append(run)
+                run = None
+            if run is None:
+                run = cur[addr] = Run(addr, t)
+            run.last = t
+            if ids:
+                run.ids = ids
+                run.advs += 1
+                run.rssi.append(rssi)
+            if rsp and run.wake is None:
+                run.wake, run.warm = rsp['wake'], rsp['warm']
+                run.delay_ms, run.intv_ms = rsp['delay_ms'], rsp['intv_ms']
+    runs.extend(cur.values())
+    # Without a scan response we can't tell what was sent
+    return [r for r in runs if r.wake is not None and r.advs]
+
+
+def read_pulses(path):
+    pulses = []
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if parts and parts[0] == 'PULSE':
+                parts = parts[1:]
+            try:
+                pulses.append(float(parts[0]))
+            except (IndexError, ValueError):
+                continue
+    return sorted(pulses)
+
+
+def crowd(runs):
+    # Other runs on air at the same time as each run
+    starts = sorted(r.first for r in runs)
+    ends = sorted(r.last for r in runs)
+    return [bisect.bisect_right(starts, r.last) - bisect.bisect_left(ends, r.first) - 1 for r in runs]
+
+
+def first_decode(runs, pulses, window_s):
+    # The latest pulse before the first adv, warm restarts were woken by one
+    # too but the tag says it was already up
+    out = []
+    for r in runs:
+        i = bisect.bisect_right(pulses, r.first)
+        if not i or r.first - pulses[i - 1] > window_s:
+            out.append(None)
+        else:
+            out.append(r.first - pulses[i - 1])
+    return out
+
+
+def band(value, edges):
+    for e in edges:
+        if value < e:
+            return e
+    return float('inf')
+
+
+def summary(title, groups, label, fmt):
+    print(title)
+    print(f"  {label:<12}{'runs':>6}{'heard':>8}{'p10':>7}{'decode':>9}")
+    for key in sorted(groups):
+        rows = groups[key]
+        ratios = sorted(r for r, _ in rows)
+        p10 = ratios[len(ratios) // 10]
+        decodes = [d for _, d in rows if d is not None]
+        dec = f'{statistics.median(decodes):.2f}s' if decodes else '-'
+        print(f'  {fmt(key):<12}{len(rows):>6}{100 * statistics.mean(ratios):>7.1f}%{100 * p10:>6.0f}%{dec:>9}')
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='LunchTrak reception ratio and time to first decode at a gate')
+    parser.add_argument('input', nargs='*', help='Packet logs, stdin without')
+    parser.add_argument('--pulses', help='WuRX pulse times, for time to first decode')
+    parser.add_argument('--gap', type=float, default=3, help='A tag quiet this long starts a new run (s)')
+    parser.add_argument('--window', type=float, default=10,
+                        help='First adv this long after a pulse or later was not woken by it (s)')
+    parser.add_argument('--min-s', type=float, default=1, help='Ignore runs heard for less than this (s)')
+    parser.add_argument('--runs', action='store_true', help='Print every run')
+    args = parser.parse_args()
+
+    files = [open(p) for p in args.input] if args.input else [sys.stdin]
+    runs = [r for r in read_runs(files, args.gap) if r.last - r.first >= args.min_s and r.intv_ms]
+    if not runs:
+        print('No runs with a LunchTrak scan response', file=sys.stderr)
+        return 1
+    density = crowd(runs)
+    decode = first_decode(runs, read_pulses(args.pulses), args.window) if args.pulses else [None] * len(runs)
+
+    if args.runs:
+        print(f"{'address':<18}{'wake':>6}{'warm':>5}{'intv':>6}{'start':>7}{'secs':>7}"
+              f"{'heard':>7}{'sent':>7}{'ratio':>7}{'rssi':>6}{'crowd':>6}{'decode':>8}")
+        for r, n, d in zip(runs, density, decode):
+            dec = f'{d:.2f}' if d is not None else '-'
+            print(f'{r.addr:<18}{r.wake:>6}{r.warm:>5}{r.intv_ms:>6}{r.delay_ms:>7}{r.last - r.first:>7.1f}'
+                  f'{r.advs:>7}{r.expected():>7}{100 * r.ratio():>6.1f}%{statistics.median(r.rssi):>6.0f}'
+                  f'{n:>6}{dec:>8}')
+        print()
+
+    rows = [(r.ratio(), d) for r, d in zip(runs, decode)]
+    by_intv, by_crowd, by_rssi = defaultdict(list), defaultdict(list), defaultdict(list)
+    for r, n, row in zip(runs, density, rows):
+        by_intv[r.intv_ms].append(row)
+        by_crowd[band(n, (5, 10, 20, 50, 100, 200))].append(row)
+        by_rssi[band(statistics.median(r.rssi), (-90, -80, -70, -60, -50))].append(row)
+
+    print(f'{len(runs)} runs from {len({r.addr for r in runs})} tags, '
+          f'{100 * statistics.mean(r for r, _ in rows):.1f}% of advs heard')
+    if args.pulses:
+        lag = [d - r.delay_ms / 1000 for r, d in zip(runs, decode) if d is not None]
+        if lag:
+            print(f'First decode {statistics.median([d for d in decode if d is not None]):.2f}s after the pulse, '
+                  f'{statistics.median(lag):.2f}s without the start delay')
+    print()
+    below = lambda k: f'< {k:g}' if k != float('inf') else 'more'
+    summary('By adv interval', by_intv, 'interval', lambda k: f'{k}ms')
+    summary('By tags on air at the same time', by_crowd, 'crowd', below)
+    summary('By median RSSI (TX power and distance)', by_rssi, 'dBm', below)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
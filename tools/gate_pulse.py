@@ -0,0 +1,242 @@
+import argparse
+import csv
+import json
+import os
+import re
+import select
+import sys
+import time
+from collections import deque
+
+# Decides when a gate sends the WuRX pattern (b4-PMU_WURX). Every pulse wakes
+# every tag in range, so pulsing on a fixed short period keeps waking tags
+# that are already advertising or already read, and a long period lets
+# students reach the register before their tag is up.
+#
+# The scheduler only pulses when someone joined the line since the last
+# pulse, holding a little so one pulse catches several, and again when the
+# adv of a student still in line has run out. The hold is a share of the
+# expected wait, from the line length and the check-in rate (Little's law).
+#   live  read "arrive" and "checkin" events on stdin, print PULSE lines
+#   sim   replay recorded check-in timelines against fixed periods and the
+#         scheduler, and compare wakes, tag charge and missed students
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+ADV_PARAMS = os.path.join(ROOT, 'src', 'cfg_adv_params.h')
+CURRENT_MODEL = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'current_model.json')
+
+
+def default_adv_s():
+    with open(ADV_PARAMS) as f:
+        m = re.search(r'#define CFG_ADV0_START_DURATION (\d+)', f.read())
+    return int(m.group(1)) / 100 if m else 300
+
+
+class PulseScheduler:
+    def __init__(self, adv_s, min_gap_s=2, max_hold_s=20, hold_share=0.25, window_s=120):
+        self.adv_s = adv_s
+        self.min_gap_s = min_gap_s
+        self.max_hold_s = max_hold_s
+        self.hold_share = hold_share
+        self.window_s = window_s
+        self.last_pulse = None
+        # Joined since the last pulse, not woken yet
+        self.pending = 0
+        self.first_pending = None
+        # Woken and still in line, oldest first: [wake time, count]
+        self.woken = deque()
+        self.checkins = deque()
+
+    def arrive(self, t):
+        if not self.pending:
+            self.first_pending = t
+        self.pending += 1
+
+    def checkin(self, t):
+        self.checkins.append(t)
+        if self.woken:
+            self.woken[0][1] -= 1
+            if not self.woken[0][1]:
+                self.woken.popleft()
+        elif self.pending:
+            # Served before we got to wake it
+            self.pending -= 1
+
+    def hold_s(self, t):
+        while self.checkins and self.checkins[0] < t - self.window_s:
+            self.checkins.popleft()
+        in_line = self.pending + sum(g[1] for g in self.woken)
+        if not self.checkins:
+            return self.max_hold_s
+        wait_s = in_line * self.window_s / len(self.checkins)
+        return min(max(wait_s * self.hold_share, self.min_gap_s), self.max_hold_s)
+
+    def tick(self, t):
+        if self.last_pulse is not None and t - self.last_pulse < self.min_gap_s:
+            return False
+
+        lapsed = [g for g in self.woken if t >= g[0] + self.adv_s]
+        if not lapsed and not (self.pending and t - self.first_pending >= self.hold_s(t)):
+            return False
+
+        # Tags still advertising ignore the pulse, the rest start over now
+        for g in lapsed:
+            g[0] = t
+        if self.pending:
+            self.woken.append([t, self.pending])
+            self.pending = 0
+        self.last_pulse = t
+        return True
+
+
+def read_timeline(path, wait_s):
+    # tag,arrive_s,checkin_s. Without an arrive time the tag is taken to
+    # join the line wait_s before it checked in
+    tags = []
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            checkin = parse_time(row['checkin_s'])
+            arrive = row.get('arrive_s')
+            arrive = parse_time(arrive) if arrive else checkin - wait_s
+            tags.append((row.get('tag', ''), arrive, checkin))
+    return sorted(tags, key=lambda x: x[1])
+
+
+def parse_time(s):
+    # Seconds, or H:MM:SS
+    parts = [float(p) for p in s.strip().split(':')]
+    secs = 0
+    for p in parts:
+        secs = secs * 60 + p
+    return secs
+
+
+def fixed_pulses(tags, period_s):
+    start = min(a for _, a, _ in tags)
+    end = max(c for _, _, c in tags)
+    pulses, t = [], start
+    while t <= end:
+        pulses.append(t)
+        t += period_s
+    return pulses
+
+
+def scheduled_pulses(tags, sched, tick_s):
+    events = sorted([(a, 0) for _, a, _ in tags] + [(c, 1) for _, _, c in tags])
+    start, end = events[0][0], events[-1][0]
+    pulses, i, t = [], 0, start
+    while t <= end:
+        while i < len(events) and events[i][0] <= t:
+            (sched.arrive if events[i][1] == 0 else sched.checkin)(events[i][0])
+            i += 1
+        if sched.tick(t):
+            pulses.append(t)
+        t += tick_s
+    return pulses
+
+
+def evaluate(tags, pulses, adv_s, leave_s):
+    # A pulse wakes a tag in range unless it is still advertising. The tag
+    # is read if it is advertising when the student checks in
+    wakes = missed = 0
+    adv_total = 0.0
+    for _, arrive, checkin in tags:
+        adv_until = None
+        read = False
+        for p in pulses:
+            if p < arrive:
+                continue
+            if p > checkin + leave_s:
+                break
+            if adv_until is None or p >= adv_until:
+                wakes += 1
+                adv_total += adv_s
+                adv_until = p + adv_s
+            if p <= checkin < adv_until:
+                read = True
+        missed += not read
+    return wakes, adv_total, missed
+
+
+def sim(args):
+    with open(CURRENT_MODEL) as f:
+        model = json.load(f)
+    wake_uc = sum(model[p]['ua'] * model[p]['us'] / 1e6 for p in ('boot', 'gap_init'))
+
+    for path in args.timeline:
+        tags = read_timeline(path, args.wait)
+        if not tags:
+            continue
+        span = max(c for _, _, c in tags) - min(a for _, a, _ in tags)
+        print(f'{path}: {len(tags)} students over {span / 60:.1f} min, adv {args.adv_s:.0f}s')
+        print(f"  {'policy':<14}{'pulses':>8}{'wakes':>8}{'per tag':>9}{'uC/tag':>9}{'read':>8}{'missed':>8}")
+
+        policies = [(f'every {p:g}s', fixed_pulses(tags, p)) for p in args.fixed]
+        sched = PulseScheduler(args.adv_s, args.min_gap, args.max_hold, args.hold_share)
+        policies.append(('scheduler', scheduled_pulses(tags, sched, args.tick)))
+
+        for name, pulses in policies:
+            wakes, adv_total, missed = evaluate(tags, pulses, args.adv_s, args.leave)
+            uc = (wakes * wake_uc + adv_total * args.adv_ua) / len(tags)
+            read = 100 * (len(tags) - missed) / len(tags)
+            print(f'  {name:<14}{len(pulses):>8}{wakes:>8}{wakes / len(tags):>9.2f}'
+                  f'{uc:>9.0f}{read:>7.1f}%{missed:>8}')
+        print()
+    return 0
+
+
+def live(args):
+    # One event per line, "arrive" or "checkin", timed by our own clock
+    sched = PulseScheduler(args.adv_s, args.min_gap, args.max_hold, args.hold_share)
+    start = time.monotonic()
+    while True:
+        ready, _, _ = select.select([sys.stdin], [], [], args.tick)
+        now = time.monotonic() - start
+        if ready:
+            line = sys.stdin.readline()
+            if not line:
+                return 0
+            kind = line.strip()
+            if kind == 'arrive':
+                sched.arrive(now)
+            elif kind == 'checkin':
+                sched.checkin(now)
+            elif kind:
+                print(f'Unknown event: {kind}', file=sys.stderr)
+        if sched.tick(now):
+            print(f'PULSE {now:.1f}', flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Plan gate WuRX pulses from line arrivals and check-ins')
+    parser.add_argument('--adv-s', type=float, default=default_adv_s(),
+                        help='How long a woken tag advertises (default CFG_ADV0_START_DURATION)')
+    parser.add_argument('--min-gap', type=float, default=2, help='Shortest time between pulses (s)')
+    parser.add_argument('--max-hold', type=float, default=20,
+                        help='Longest a new arrival waits for its pulse (s)')
+    parser.add_argument('--hold-share', type=float, default=0.25,
+                        help='Hold new arrivals for this share of the expected wait')
+    parser.add_argument('--tick', type=float, default=1, help='Scheduler step (s)')
+    sub = parser.add_subparsers(required=True)
+
+    p = sub.add_parser('live', help='Read events on stdin and print when to pulse')
+    p.set_defaults(func=live)
+
+    p = sub.add_parser('sim', help='Compare pulse policies on recorded timelines')
+    p.add_argument('timeline', nargs='+', help='CSV with tag,arrive_s,checkin_s (arrive_s may be empty)')
+    p.add_argument('--fixed', type=float, nargs='*', default=[5, 15, 30, 60],
+                   help='Fixed pulse periods to compare against (s)')
+    p.add_argument('--wait', type=float, default=60,
+                   help='Time in line when the timeline has no arrive time (s)')
+    p.add_argument('--leave', type=float, default=5,
+                   help='Time a tag stays in range after checking in (s)')
+    p.add_argument('--adv-ua', type=float, default=60,
+                   help='Average tag current while advertising, 6uC events every 100ms by default')
+    p.set_defaults(func=sim)
+
+    args = parser.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == '__main__':
+    main()
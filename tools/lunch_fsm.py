@@ -0,0 +1,145 @@
+import argparse
+import os
+import re
+import sys
+
+# Reads the app state machine spec (lunch_fsm.def), the same one the
+# firmware builds its enums and [state][op] table from.
+#   check    spec errors the C compiler can't see, and README drift
+#   mermaid  print the README diagram, or rewrite it with --update
+#   run      feed ops to the host model and print the states it goes through
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+SPEC = os.path.join(ROOT, 'lunch_fsm.def')
+README = os.path.join(ROOT, 'README.md')
+MERMAID_RE = re.compile(r'(## State Diagram\s*```mermaid\n)(.*?)(```)', re.S)
+
+
+class LunchFsm:
+    """Host model of the app state machine.
+
+    Handlers can still force a state with lunch_fsm_set(), which the spec
+    doesn't know about, so this follows the table only.
+    """
+
+    def __init__(self, path=SPEC):
+        with open(path) as f:
+            text = re.sub(r'/\*.*?\*/|//[^\n]*', '', f.read(), flags=re.S)
+        # Skip the default empty definitions at the top
+        text = re.sub(r'#ifndef.*?#endif', '', text, flags=re.S)
+        self.states = re.findall(r'^LUNCH_STATE\((\w+)\)', text, re.M)
+        self.ops = re.findall(r'^LUNCH_OP\((\w+)\)', text, re.M)
+        self.trans = [tuple(x.strip() for x in m.split(','))
+                      for m in re.findall(r'^LUNCH_TRANS\(([^)]*)\)', text, re.M)]
+        self.table = {(s, o): (n, h) for s, o, n, h in self.trans}
+        self.reset()
+
+    def reset(self):
+        self.state = self.states[0]
+
+    def move(self, op):
+        if (self.state, op) not in self.table:
+            raise KeyError(f'No transition from {self.state} on {op}')
+        last = self.state
+        self.state, handler = self.table[(last, op)]
+        return last, self.state, handler
+
+    def errors(self):
+        errs = []
+        for kind, names in (('state', self.states), ('op', self.ops)):
+            dups = {n for n in names if names.count(n) > 1}
+            errs += [f'{kind} {n} listed twice' for n in sorted(dups)]
+
+        seen = set()
+        for s, o, n, h in self.trans:
+            if (s, o) in seen:
+                errs.append(f'two transitions for {s} on {o}')
+            seen.add((s, o))
+            for name, known in ((s, self.states), (o, self.ops), (n, self.states)):
+                if name not in known:
+                    errs.append(f'{s} on {o}: unknown {name}')
+
+        # Everything must be reachable from the first state
+        reached, todo = {self.states[0]}, [self.states[0]]
+        while todo:
+            cur = todo.pop()
+            for s, o, n, h in self.trans:
+                if s == cur and n not in reached:
+                    reached.add(n)
+                    todo.append(n)
+        errs += [f'{s} is unreachable from {self.states[0]}' for s in self.states if s not in reached]
+
+        errs += [f'{s} has no way out' for s in self.states
+                 if not any(t[0] == s and t[2] != s for t in self.trans)]
+        errs += [f'{o} is never used' for o in self.ops if not any(t[1] == o for t in self.trans)]
+        return errs
+
+    def mermaid(self):
+        lines = ['stateDiagram', f'    [*] --> {self.states[0]}']
+        lines += [f'    {s} --> {n}: {o}' for s, o, n, h in self.trans]
+        return '\n'.join(lines) + '\n'
+
+
+def readme_diagram():
+    with open(README) as f:
+        m = MERMAID_RE.search(f.read())
+    return m.group(2) if m else None
+
+
+def check(fsm, args):
+    errs = fsm.errors()
+    if readme_diagram() != fsm.mermaid():
+        errs.append('README.md state diagram is out of date, run tools/lunch_fsm.py mermaid --update')
+    for e in errs:
+        print(f'lunch_fsm.def: {e}', file=sys.stderr)
+    return 1 if errs else 0
+
+
+def mermaid(fsm, args):
+    if not args.update:
+        print(fsm.mermaid(), end='')
+        return 0
+    with open(README) as f:
+        text = f.read()
+    text, n = MERMAID_RE.subn(lambda m: m.group(1) + fsm.mermaid() + m.group(3), text)
+    if not n:
+        print('No "## State Diagram" mermaid block in README.md', file=sys.stderr)
+        return 1
+    with open(README, 'w') as f:
+        f.write(text)
+    return 0
+
+
+def run(fsm, args):
+    for op in args.ops:
+        try:
+            last, nxt, handler = fsm.move(op)
+        except KeyError as e:
+            print(e.args[0], file=sys.stderr)
+            return 1
+        print(f'{last} --{op}--> {nxt}  ({handler})')
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Check, draw and run the LunchTrak state machine spec')
+    parser.add_argument('--spec', default=SPEC)
+    sub = parser.add_subparsers(required=True)
+
+    p = sub.add_parser('check', help='Check the spec and the README diagram')
+    p.set_defaults(func=check)
+
+    p = sub.add_parser('mermaid', help='Print the state diagram')
+    p.add_argument('--update', action='store_true', help='Rewrite the diagram in README.md')
+    p.set_defaults(func=mermaid)
+
+    p = sub.add_parser('run', help='Run ops through the host model')
+    p.add_argument('ops', nargs='+', help='e.g. OP_MODULE_INIT OP_CREATE_LUNCH_ADV')
+    p.set_defaults(func=run)
+
+    args = parser.parse_args()
+    sys.exit(args.func(LunchFsm(args.spec), args))
+
+
+if __name__ == '__main__':
+    main()
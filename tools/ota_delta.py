@@ -0,0 +1,261 @@
+import argparse
+import hashlib
+import hmac
+import os
+import struct
+import sys
+import zlib
+
+# Binary deltas for OTA updates over the pairing connection, decoded on the
+# tag by src/non_bt/lunch_ota.c as they arrive. A delta file is:
+#   "LOTA", then lunch_ota_start_t (base len and crc, image len and crc,
+#   delta len, HMAC-SHA256 of the image), then ops. Each op is one byte and
+#   LEB128 args:
+#   COPY src len        copy from the running image
+#   INSERT len bytes..  literal bytes
+#   FILL len byte       one byte repeated (erased flash, zero padding)
+# The header after the magic is exactly what the START command carries.
+# The MAC is keyed with the fleet key the tags have in NVDS tag 0xDA. It is
+# a shared key, anyone holding it can make an image the tags will take.
+#   keygen write a new fleet key as a tds for tag_data/da-OTA_KEY
+#   make   build a delta from two firmware .bin files (objcopy -O binary)
+#   apply  run a delta on the host, like the tag does, and check crc and mac
+#   info   header, op counts and what the transfer takes at a given MTU
+
+MAGIC = b'LOTA'
+KEY_LEN = 32
+HEADER = struct.Struct('<5I32s')
+TAG_DATA = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'tag_data')
+
+# Keep in sync with src/non_bt/lunch_ota.h
+OP_COPY, OP_INSERT, OP_FILL = 1, 2, 3
+CMD_START = 1
+DATA_OFS_LEN = 4  # delta offset in front of every data write
+ATT_WRITE_OVERHEAD = 3
+
+GRAM = 8        # bytes hashed to find copy candidates
+MIN_COPY = 12   # shorter matches cost more as a COPY than as literals
+MIN_FILL = 16
+MAX_CANDIDATES = 16
+
+
+def leb128(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7f
+        n >>= 7
+        out.append(b | (0x80 if n else 0))
+        if not n:
+            return bytes(out)
+
+
+def read_leb128(data, i):
+    n = shift = 0
+    while True:
+        b = data[i]
+        i += 1
+        n |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return n, i
+
+
+def read_key(path):
+    # tds: hex bytes, # starts a comment
+    with open(path) as f:
+        key = bytes.fromhex(''.join(line.partition('#')[0] for line in f))
+    if len(key) != KEY_LEN:
+        raise SystemExit(f'{path}: key is {len(key)} bytes, not {KEY_LEN}')
+    return key
+
+
+def image_mac(key, image):
+    return hmac.new(key, image, hashlib.sha256).digest()
+
+
+def make_delta(old, new, key):
+    index = {}
+    for i in range(len(old) - GRAM + 1):
+        cands = index.setdefault(old[i:i + GRAM], [])
+        if len(cands) < MAX_CANDIDATES:
+            cands.append(i)
+
+    ops = bytearray()
+    lit = bytearray()
+
+    def flush():
+        if lit:
+            ops.extend(bytes([OP_INSERT]) + leb128(len(lit)) + lit)
+            lit.clear()
+
+    i = 0
+    while i < len(new):
+        run = 1
+        while i + run < len(new) and new[i + run] == new[i]:
+            run += 1
+        if run >= MIN_FILL:
+            flush()
+            ops.extend(bytes([OP_FILL]) + leb128(run) + bytes([new[i]]))
+            i += run
+            continue
+
+        best_src, best_len = 0, 0
+        for src in index.get(new[i:i + GRAM], ()):
+            n = GRAM
+            while src + n < len(old) and i + n < len(new) and old[src + n] == new[i + n]:
+                n += 1
+            if n > best_len:
+                best_src, best_len = src, n
+        if best_len >= MIN_COPY:
+            flush()
+            ops.extend(bytes([OP_COPY]) + leb128(best_src) + leb128(best_len))
+            i += best_len
+        else:
+            lit.append(new[i])
+            i += 1
+    flush()
+
+    header = HEADER.pack(len(old), zlib.crc32(old), len(new), zlib.crc32(new), len(ops), image_mac(key, new))
+    return MAGIC + header + bytes(ops)
+
+
+def parse(delta):
+    if delta[:4] != MAGIC:
+        raise SystemExit('Not a LunchTrak OTA delta')
+    header = HEADER.unpack_from(delta, 4)
+    ops = delta[4 + HEADER.size:]
+    if len(ops) != header[4]:
+        raise SystemExit(f'Delta is {len(ops)} bytes, header says {header[4]}')
+    return header, ops
+
+
+def apply_delta(old, ops, counts=None):
+    out = bytearray()
+    i = 0
+    while i < len(ops):
+        op = ops[i]
+        i += 1
+        if op == OP_COPY:
+            src, i = read_leb128(ops, i)
+            n, i = read_leb128(ops, i)
+            out += old[src:src + n]
+        elif op == OP_INSERT:
+            n, i = read_leb128(ops, i)
+            out += ops[i:i + n]
+            i += n
+        elif op == OP_FILL:
+            n, i = read_leb128(ops, i)
+            out += bytes([ops[i]]) * n
+            i += 1
+        else:
+            raise SystemExit(f'Bad op {op:#x} at {i - 1}')
+        if counts is not None:
+            counts[op] = counts.get(op, 0) + 1
+    return bytes(out)
+
+
+def cmd_keygen(args):
+    path = os.path.join(TAG_DATA, 'da-OTA_KEY', args.name + '.tds')
+    if os.path.exists(path):
+        raise SystemExit(f'{path} exists, a new key locks out every tag flashed with the old one')
+    with open(path, 'w') as f:
+        f.write('# OTA fleet key, HMAC-SHA256 of every image. Keep it out of git\n')
+        f.write(' '.join(f'{b:02x}' for b in os.urandom(KEY_LEN)) + '\n')
+    print(f'Wrote {os.path.relpath(path)}, build with OTA=1 OTA_KEY={args.name}')
+    return 0
+
+
+def cmd_make(args):
+    old = open(args.old, 'rb').read()
+    new = open(args.new, 'rb').read()
+    delta = make_delta(old, new, read_key(args.key))
+    with open(args.out, 'wb') as f:
+        f.write(delta)
+    print(f'{args.out}: {len(delta)} bytes for a {len(new)} byte image ({100 * len(delta) / len(new):.1f}%)')
+
+    # Never ship a delta we can't undo on the host
+    if apply_delta(old, parse(delta)[1]) != new:
+        raise SystemExit('Delta does not rebuild the new image')
+    return 0
+
+
+def cmd_apply(args):
+    old = open(args.old, 'rb').read()
+    (base_len, base_crc, image_len, image_crc, _, mac), ops = parse(open(args.delta, 'rb').read())
+    if len(old) != base_len or zlib.crc32(old) != base_crc:
+        print('Base image does not match the delta', file=sys.stderr)
+        return 1
+    new = apply_delta(old, ops)
+    if len(new) != image_len or zlib.crc32(new) != image_crc:
+        print('Rebuilt image does not match the crc', file=sys.stderr)
+        return 1
+    if args.key and not hmac.compare_digest(image_mac(read_key(args.key), new), mac):
+        print('Image mac does not match the key', file=sys.stderr)
+        return 1
+    if args.out:
+        with open(args.out, 'wb') as f:
+            f.write(new)
+    print(f'OK, {image_len} bytes crc={image_crc:#010x}')
+    return 0
+
+
+def cmd_info(args):
+    raw = open(args.delta, 'rb').read()
+    (base_len, base_crc, image_len, image_crc, delta_len, mac), ops = parse(raw)
+    counts = {}
+    if args.old:
+        apply_delta(open(args.old, 'rb').read(), ops, counts)
+    print(f'base   {base_len} bytes crc={base_crc:#010x}')
+    print(f'image  {image_len} bytes crc={image_crc:#010x}')
+    print(f'mac    {mac.hex()}')
+    print(f'delta  {delta_len} bytes ({100 * delta_len / image_len:.1f}% of the image)')
+    if counts:
+        print('ops    ' + ', '.join(f'{n} {k}' for k, n in
+                                   (('copy', counts.get(OP_COPY, 0)), ('insert', counts.get(OP_INSERT, 0)),
+                                    ('fill', counts.get(OP_FILL, 0)))))
+    print(f'start  {bytes([CMD_START]).hex()}{raw[4:4 + HEADER.size].hex()}')
+
+    # Write requests, so one chunk per connection event and one for the response
+    chunk = min(args.mtu - ATT_WRITE_OVERHEAD - DATA_OFS_LEN, args.chunk_max)
+    chunks = -(-delta_len // chunk)
+    secs = chunks * 2 * args.conn_ms / 1000
+    print(f'MTU {args.mtu}: {chunks} writes of up to {chunk} bytes, about {secs:.1f}s at {args.conn_ms}ms')
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Make and check LunchTrak OTA deltas')
+    sub = parser.add_subparsers(required=True)
+
+    p = sub.add_parser('keygen', help='New fleet key for tag_data/da-OTA_KEY')
+    p.add_argument('name', help='tds file name, the OTA_KEY of the build')
+    p.set_defaults(func=cmd_keygen)
+
+    p = sub.add_parser('make', help='Delta from the running image to the new one')
+    p.add_argument('old', help='Image the tags run now (.bin)')
+    p.add_argument('new', help='Image to update them to (.bin)')
+    p.add_argument('-o', '--out', required=True)
+    p.add_argument('--key', required=True, help='Fleet key tds from keygen')
+    p.set_defaults(func=cmd_make)
+
+    p = sub.add_parser('apply', help='Rebuild the new image on the host')
+    p.add_argument('old')
+    p.add_argument('delta')
+    p.add_argument('-o', '--out')
+    p.add_argument('--key', help='Fleet key tds, to check the mac too')
+    p.set_defaults(func=cmd_apply)
+
+    p = sub.add_parser('info', help='Show a delta and its transfer at a given MTU')
+    p.add_argument('delta')
+    p.add_argument('--old', help='Base image, to count ops')
+    p.add_argument('--mtu', type=int, default=247)
+    p.add_argument('--chunk-max', type=int, default=508, help='CFG_LUNCH_OTA_CHUNK_MAX of the tag')
+    p.add_argument('--conn-ms', type=float, default=15, help='Connection interval')
+    p.set_defaults(func=cmd_info)
+
+    args = parser.parse_args()
+    sys.exit(args.func(args))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+import argparse
+import os
+import re
+import sys
+
+# Turns "#T <ts> <id|nargs> <args>" lines from lunch_log.c back into the
+# same text ATM_LOG would have printed. Everything else passes through.
+
+REPO_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+IDS_H = os.path.join('src', 'non_bt', 'lunch_log_ids.h')
+
+ID_RE = re.compile(r'^\s*(LL_\w+),', re.M)
+MODULE_RE = re.compile(r'ATM_LOG_LOCAL_SETTING\("(\w+)"')
+CALL_RE = re.compile(r'LUNCH_LOG\(\s*(\w)\s*,\s*(LL_\w+)\s*,\s*"((?:[^"\\]|\\.)*)"')
+RECORD_RE = re.compile(r'#T ([0-9a-f]{8}) ([0-9a-f]+)((?: [0-9a-f]+)*)\s*$')
+
+
+def load_ids(repo):
+    with open(os.path.join(repo, IDS_H)) as f:
+        return ID_RE.findall(f.read())
+
+
+def load_calls(repo):
+    calls = {}
+    for root, _, files in os.walk(repo):
+        for name in files:
+            if not name.endswith('.c'):
+                continue
+            with open(os.path.join(root, name), errors='replace') as f:
+                src = f.read()
+            m = MODULE_RE.search(src)
+            module = m.group(1) if m else name[:-2]
+            for lvl, lid, fmt in CALL_RE.findall(src):
+                calls[lid] = (module, lvl, fmt.encode().decode('unicode_escape'))
+    return calls
+
+
+def to_signed(v):
+    return v - (1 << 32) if v & (1 << 31) else v
+
+
+def format_msg(fmt, args):
+    # Python knows %d/%u/%x and ignores the C length modifiers
+    conv = re.findall(r'%[#0-9.]*l*([a-zA-Z%])', fmt)
+    vals = []
+    for c, v in zip([c for c in conv if c != '%'], args):
+        vals.append(to_signed(v) if c in 'di' else v)
+    try:
+        return fmt % tuple(vals)
+    except (TypeError, ValueError):
+        return f"{fmt} {' '.join(hex(a) for a in args)}"
+
+
+def decode(lines, ids, calls, out):
+    for line in lines:
+        m = RECORD_RE.search(line)
+        if not m:
+            out.write(line)
+            continue
+
+        ts = int(m.group(1), 16)
+        hdr = int(m.group(2), 16)
+        args = [int(a, 16) for a in m.group(3).split()]
+        lid_num = hdr & 0xff
+
+        if lid_num >= len(ids) or ids[lid_num] not in calls:
+            out.write(f'@{ts:08x} [  unknown][?]: id={lid_num} args={args}\n')
+            continue
+
+        module, lvl, fmt = calls[ids[lid_num]]
+        out.write(f'@{ts:08x} [{module[:10]:>10}][{lvl}]: {format_msg(fmt, args)}\n')
+
+
+parser = argparse.ArgumentParser(description='Decode LunchTrak tokenized log')
+parser.add_argument('log', nargs='?', help='Captured UART log (default stdin)')
+parser.add_argument('--repo', default=REPO_DIR, help='Source tree the firmware was built from')
+args = parser.parse_args()
+
+ids = load_ids(args.repo)
+calls = load_calls(args.repo)
+
+if args.log:
+    with open(args.log, errors='replace') as f:
+        decode(f, ids, calls, sys.stdout)
+else:
+    decode(sys.stdin, ids, calls, sys.stdout)
@@ -0,0 +1,155 @@
+import argparse
+import json
+import re
+
+from lunch_fsm import LunchFsm
+
+# Converts "#E" trace dumps from lunch_trace.c into Chrome trace JSON.
+# Open the result in chrome://tracing or https://ui.perfetto.dev
+# Pass several captures (e.g. two firmware versions) to see them side by side.
+
+# Keep in sync with lunch_trace_type_t in src/non_bt/lunch_trace.h
+TR_BOOT, TR_STATE, TR_ADV_STATE, TR_GAP, TR_PM_LOCK, TR_PM_UNLOCK, \
+    TR_NVDS_GET, TR_NVDS_PUT, TR_HIB, TR_SLEEP, TR_OP_WAIT, TR_NVDS_HIT = range(12)
+
+# APP_STATE/APP_OP come from the same spec as lunch_beacon.h
+FSM = LunchFsm()
+STATES = FSM.states
+OPS = dict(enumerate(FSM.ops))
+OPS[0xff] = 'OP_END'
+# atm_adv_state_t
+ADV_STATES = ['ATM_ADV_IDLE', 'ATM_ADV_CREATING', 'ATM_ADV_CREATED', 'ATM_ADV_ADVDATA_SETTING',
+              'ATM_ADV_ADVDATA_DONE', 'ATM_ADV_SCANDATA_SETTING', 'ATM_ADV_SCANDATA_DONE',
+              'ATM_ADV_OFF', 'ATM_ADV_STARTING', 'ATM_ADV_ON', 'ATM_ADV_STOPPING',
+              'ATM_ADV_DELETING', 'ATM_ADV_DELETED']
+GAP = ['gap_init_cfm', 'gap_conn_ind', 'gap_disc_ind']
+# Keep in sync with lunch_sleep_hold_t in src/non_bt/lunch_sleep.h
+SLEEP_HOLD = ['led', 'button', 'log']
+
+REC_RE = re.compile(r'#E ([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]+) ([0-9a-f]+) ([0-9a-f]+)')
+TID_STATE, TID_ADV, TID_PM, TID_EVENTS = 1, 2, 3, 4
+
+
+def name(table, idx):
+    if isinstance(table, dict):
+        return table.get(idx, str(idx))
+    return table[idx] if idx < len(table) else str(idx)
+
+
+def read_records(path):
+    recs = []
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = REC_RE.search(line)
+            if m:
+                recs.append(tuple(int(g, 16) for g in m.groups()))
+    return recs
+
+
+def convert(recs, pid, cpu_mhz):
+    events = []
+    if not recs:
+        return events
+
+    t0 = recs[0][0]
+    prev_cyc = None
+    queued_us = None  # from TR_OP_WAIT, shown on the transition it led to
+    open_slices = {}  # track -> (name, ts)
+    pm_open = {}
+
+    def close(tid, ts):
+        if tid in open_slices:
+            n, start = open_slices.pop(tid)
+            events.append({'name': n, 'ph': 'X', 'pid': pid, 'tid': tid,
+                           'ts': start, 'dur': max(ts - start, 0)})
+
+    for sys_time, cycles, typ, a, b in recs:
+        ts = (sys_time - t0) & 0xffffffff  # us
+        args = {}
+        if prev_cyc is not None:
+            args['cpu_us_since_prev'] = round(((cycles - prev_cyc) & 0xffffffff) / cpu_mhz, 2)
+        prev_cyc = cycles
+
+        if typ == TR_BOOT:
+            events.append({'name': 'cold boot' if a else 'wake', 'ph': 'i', 's': 'p',
+                           'pid': pid, 'tid': TID_EVENTS, 'ts': ts, 'args': args})
+        elif typ == TR_STATE:
+            close(TID_STATE, ts)
+            args['op'] = name(OPS, b >> 8)
+            args['from'] = name(STATES, a)
+            if queued_us is not None:
+                args['queued_us'] = queued_us
+                queued_us = None
+            open_slices[TID_STATE] = (name(STATES, b & 0xff), ts)
+            events.append({'name': args['op'], 'ph': 'i', 's': 't', 'pid': pid,
+                           'tid': TID_STATE, 'ts': ts, 'args': args})
+        elif typ == TR_OP_WAIT:
+            queued_us = b
+        elif typ == TR_ADV_STATE:
+            tid = TID_ADV * 100 + a
+            close(tid, ts)
+            open_slices[tid] = (name(ADV_STATES, b), ts)
+        elif typ == TR_GAP:
+            events.append({'name': name(GAP, a), 'ph': 'i', 's': 't', 'pid': pid,
+                           'tid': TID_EVENTS, 'ts': ts, 'args': args})
+        elif typ == TR_PM_LOCK:
+            pm_open.setdefault(a, ts)
+        elif typ == TR_PM_UNLOCK:
+            if a in pm_open:
+                start = pm_open.pop(a)
+                events.append({'name': f'pm lock {a}', 'ph': 'X', 'pid': pid,
+                               'tid': TID_PM, 'ts': start, 'dur': ts - start})
+        elif typ in (TR_NVDS_GET, TR_NVDS_PUT, TR_NVDS_HIT):
+            op = {TR_NVDS_GET: 'get', TR_NVDS_PUT: 'put', TR_NVDS_HIT: 'hit'}[typ]
+            args.update({'tag': hex(a), 'err': b})
+            events.append({'name': f'nvds_{op} {a:#04x}', 'ph': 'i', 's': 't', 'pid': pid,
+                           'tid': TID_EVENTS, 'ts': ts, 'args': args})
+        elif typ == TR_SLEEP:
+            # Closed by TR_HIB, the slice is the tail we want to shorten
+            args['holders'] = [n for i, n in enumerate(SLEEP_HOLD) if a & (1 << i)]
+            open_slices[TID_EVENTS] = ('sleep tail', ts)
+            events.append({'name': 'teardown', 'ph': 'i', 's': 't', 'pid': pid,
+                           'tid': TID_EVENTS, 'ts': ts, 'args': args})
+        elif typ == TR_HIB:
+            for tid in list(open_slices):
+                close(tid, ts)
+            events.append({'name': 'hibernate', 'ph': 'i', 's': 'p', 'pid': pid,
+                           'tid': TID_EVENTS, 'ts': ts, 'args': args})
+
+    end = (recs[-1][0] - t0) & 0xffffffff
+    for tid in list(open_slices):
+        close(tid, end)
+    for lock, start in pm_open.items():
+        events.append({'name': f'pm lock {lock}', 'ph': 'X', 'pid': pid,
+                       'tid': TID_PM, 'ts': start, 'dur': end - start})
+
+    return events
+
+
+def metadata(pid, label, adv_tids):
+    meta = [{'name': 'process_name', 'ph': 'M', 'pid': pid, 'args': {'name': label}}]
+    tids = {TID_STATE: 's_tbl', TID_PM: 'pm locks', TID_EVENTS: 'events'}
+    tids.update({t: f'adv act_idx {t % 100}' for t in adv_tids})
+    for tid, n in tids.items():
+        meta.append({'name': 'thread_name', 'ph': 'M', 'pid': pid, 'tid': tid, 'args': {'name': n}})
+    return meta
+
+
+parser = argparse.ArgumentParser(description='Convert LunchTrak trace dumps to Chrome trace JSON')
+parser.add_argument('captures', nargs='+', help='UART captures with #E lines')
+parser.add_argument('--label', action='append', help='Name for each capture (e.g. firmware version)')
+parser.add_argument('--cpu-mhz', type=float, default=64, help='CPU clock for the cycle counter')
+parser.add_argument('-o', '--output', default='trace.json')
+args = parser.parse_args()
+
+trace = []
+for pid, path in enumerate(args.captures, 1):
+    label = args.label[pid - 1] if args.label and len(args.label) >= pid else path
+    events = convert(read_records(path), pid, args.cpu_mhz)
+    adv_tids = {e['tid'] for e in events if e['tid'] >= TID_ADV * 100}
+    trace += metadata(pid, label, adv_tids) + events
+
+with open(args.output, 'w') as f:
+    json.dump({'traceEvents': trace, 'displayTimeUnit': 'ms'}, f)
+
+print(f'Wrote {len(trace)} events to {args.output}')
@@ -0,0 +1,156 @@
+import argparse
+import glob
+import re
+import statistics
+import subprocess
+
+# Compares builds with and without FAST_WAKE, or the full and BEACON_ONLY
+# builds (or any two): where the wake path functions were linked, section
+# sizes, flash and RAM, and the time from boot to the lunch adv being on,
+# measured from TRACE=1 captures.
+
+# Keep in sync with lunch_trace_type_t in src/non_bt/lunch_trace.h
+TR_BOOT, TR_ADV_STATE = 0, 2
+ATM_ADV_ON = 9
+REC_RE = re.compile(r'#E ([0-9a-f]{8}) ([0-9a-f]{8}) ([0-9a-f]+) ([0-9a-f]+) ([0-9a-f]+)')
+
+# Function definitions marked for RAM, see src/non_bt/lunch_wake.h
+MARK_RE = re.compile(r'^(__WAKE_PATH|__FAST)\s+(?:static\s+)?[\w\s\*]*?\b(\w+)\s*\(', re.M)
+SOURCES = ['*.c', 'src/**/*.c']
+
+
+def wake_path_funcs(root):
+    funcs = {}
+    for pattern in SOURCES:
+        for path in glob.glob(f'{root}/{pattern}', recursive=True):
+            with open(path, errors='replace') as f:
+                src = f.read()
+            # Return type can sit on the line after the mark
+            src = re.sub(r'^(__WAKE_PATH|__FAST)\s+(static\s+)?(\w+)\n', r'\1 \2\3 ', src, flags=re.M)
+            for m in MARK_RE.finditer(src):
+                funcs[m.group(2)] = m.group(1)
+    return funcs
+
+
+def read_symbols(nm, elf):
+    out = subprocess.run([nm, '-S', elf], capture_output=True, text=True, check=True).stdout
+    syms = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 4 and parts[2] in 'tT':
+            syms[parts[3]] = (int(parts[0], 16), int(parts[1], 16))
+    return syms
+
+
+def read_sections(size, elf):
+    out = subprocess.run([size, '-A', elf], capture_output=True, text=True, check=True).stdout
+    sections = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[0].startswith('.') and parts[1].isdigit():
+            if int(parts[1]):
+                sections[parts[0]] = (int(parts[1]), int(parts[2]))
+    return sections
+
+
+def flash_ram(sections, ram_base):
+    # Initialized RAM sections also take their load image in flash
+    flash = ram = 0
+    for name, (sz, addr) in sections.items():
+        if addr >= ram_base:
+            ram += sz
+            if name not in ('.bss', '.noinit', '.heap', '.stack'):
+                flash += sz
+        elif addr:
+            flash += sz
+    return flash, ram
+
+
+def boot_to_adv(path, cpu_mhz):
+    # One sample per boot in the capture: TR_BOOT to the first ATM_ADV_ON
+    samples = []
+    boot = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            m = REC_RE.search(line)
+            if not m:
+                continue
+            sys_time, cycles, typ, a, b = (int(g, 16) for g in m.groups())
+            if typ == TR_BOOT:
+                boot = (sys_time, cycles)
+            elif typ == TR_ADV_STATE and b == ATM_ADV_ON and boot:
+                us = (sys_time - boot[0]) & 0xffffffff
+                cpu_us = ((cycles - boot[1]) & 0xffffffff) / cpu_mhz
+                samples.append((us, cpu_us))
+                boot = None
+    return samples
+
+
+def fmt_delta(old, new):
+    if old is None or new is None:
+        return ''
+    return f'{new - old:+d}'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare LunchTrak wake path placement and boot to adv time')
+    parser.add_argument('--build', nargs=3, action='append', required=True,
+                        metavar=('LABEL', 'ELF', 'TRACE'),
+                        help='Build label, its elf and a TRACE=1 UART capture (- for none). First is the baseline')
+    parser.add_argument('--root', default='.', help='Source tree to read __WAKE_PATH marks from')
+    parser.add_argument('--nm', default='arm-none-eabi-nm')
+    parser.add_argument('--size', default='arm-none-eabi-size')
+    parser.add_argument('--ram-base', type=lambda x: int(x, 0), default=0x20000000,
+                        help='Code at or above this address runs from RAM')
+    parser.add_argument('--cpu-mhz', type=float, default=64, help='CPU clock for the cycle counter')
+    args = parser.parse_args()
+
+    labels = [b[0] for b in args.build]
+    funcs = wake_path_funcs(args.root)
+    syms = [read_symbols(args.nm, b[1]) for b in args.build]
+    sections = [read_sections(args.size, b[1]) for b in args.build]
+
+    print('Wake path placement (RAM/flash, bytes)')
+    print(f"  {'function':<28}" + ''.join(f'{l:>16}' for l in labels))
+    ram_bytes = [0] * len(labels)
+    for name in sorted(funcs):
+        row = f'  {name:<28}'
+        for i, s in enumerate(syms):
+            if name not in s:
+                row += f"{'-':>16}"
+                continue
+            addr, sz = s[name]
+            where = 'RAM' if addr >= args.ram_base else 'flash'
+            if where == 'RAM':
+                ram_bytes[i] += sz
+            row += f'{where + " " + str(sz):>16}'
+        print(row)
+    print(f"  {'in RAM':<28}" + ''.join(f'{b:>16}' for b in ram_bytes))
+
+    print('\nSections (bytes)')
+    print(f"  {'section':<28}" + ''.join(f'{l:>16}' for l in labels) + f"{'delta':>10}")
+    for name in sorted(set().union(*sections)):
+        sizes = [s[name][0] if name in s else None for s in sections]
+        row = f'  {name:<28}' + ''.join(f"{'-' if v is None else v:>16}" for v in sizes)
+        print(row + f'{fmt_delta(sizes[0], sizes[-1]):>10}')
+
+    totals = [flash_ram(s, args.ram_base) for s in sections]
+    for col, title in ((0, 'flash'), (1, 'RAM')):
+        row = f'  {title:<28}' + ''.join(f'{t[col]:>16}' for t in totals)
+        print(row + f'{fmt_delta(totals[0][col], totals[-1][col]):>10}')
+
+    print('\nBoot to lunch adv on (us, median)')
+    print(f"  {'':<28}" + ''.join(f'{l:>16}' for l in labels))
+    results = []
+    for b in args.build:
+        samples = boot_to_adv(b[2], args.cpu_mhz) if b[2] != '-' else []
+        results.append(samples)
+    for col, title in ((0, 'sys time'), (1, 'cpu cycles')):
+        row = f'  {title:<28}'
+        for samples in results:
+            row += f'{statistics.median(s[col] for s in samples):>16.0f}' if samples else f"{'-':>16}"
+        print(row)
+    print(f"  {'boots':<28}" + ''.join(f'{len(s):>16}' for s in results))
+
+
+main()